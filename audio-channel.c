@@ -1,4 +1,5 @@
 #include "audio-channel.h"
+#include "audio-kernels.h"
 #include <inttypes.h>
 #include <obs.h>
 #include <util/platform.h>
@@ -7,21 +8,20 @@
 /* maximum timestamp variance in nanoseconds */
 #define MAX_TS_VAR 2000000000ULL
 
-/* maximum buffer size */
-#define MAX_BUF_SIZE (1000 * AUDIO_OUTPUT_FRAMES * sizeof(float))
-
 /* time threshold in nanoseconds to ensure audio timing is as seamless as
  * possible */
 #define TS_SMOOTHING_THRESHOLD 70000000ULL
 
+#define RING_BYTES (AUDIO_CHANNEL_RING_FRAMES * sizeof(float))
+
 static inline uint64_t uint64_diff(uint64_t ts1, uint64_t ts2)
 {
 	return (ts1 < ts2) ? (ts2 - ts1) : (ts1 - ts2);
 }
 
-static inline size_t get_buf_placement(uint32_t sample_rate, uint64_t offset)
+static inline size_t conv_time_to_frames(const struct audio_channel *source, uint64_t t)
 {
-	return (size_t)(offset * (uint64_t)sample_rate / 1000000000ULL);
+	return convert_time_to_frames(source->out_sample_info.samples_per_sec, t);
 }
 
 /* unless the value is 3+ hours worth of frames, this won't overflow */
@@ -38,19 +38,6 @@ static inline void reset_audio_timing(struct audio_channel *source, uint64_t tim
 	source->timing_adjust = os_time - timestamp;
 }
 
-static void reset_audio_data(struct audio_channel *source, uint64_t os_time)
-{
-	blog(LOG_DEBUG, "audio channel:0x%p reset_audio_data, time: %lld", source, os_time);
-	for (size_t i = 0; i < MAX_AUDIO_CHANNELS; i++) {
-		if (source->audio_input_buf[i].size)
-			circlebuf_pop_front(&source->audio_input_buf[i], NULL, source->audio_input_buf[i].size);
-	}
-
-	source->last_audio_input_buf_size = 0;
-	source->audio_ts = os_time;
-	source->next_audio_sys_ts_min = os_time;
-}
-
 static void handle_ts_jump(struct audio_channel *source, uint64_t expected, uint64_t ts, uint64_t diff, uint64_t os_time)
 {
 	blog(LOG_DEBUG,
@@ -58,57 +45,157 @@ static void handle_ts_jump(struct audio_channel *source, uint64_t expected, uint
 	     "expected value %" PRIu64 ", input value %" PRIu64,
 	     source, diff, expected, ts);
 
-	pthread_mutex_lock(&source->audio_buf_mutex);
 	reset_audio_timing(source, ts, os_time);
-	pthread_mutex_unlock(&source->audio_buf_mutex);
 }
 
-static void audio_channel_output_audio_place(struct audio_channel *source, const struct audio_data *in)
+/* ------------------------------------------------------------------------- */
+/* capture side                                                              */
+
+static inline void publish_meta(struct audio_channel *source)
+{
+	channel_ring_publish(&source->ring, &source->pub);
+}
+
+/* frames [src_pos, src_pos + frames) of the packet into the planes of dst,
+ * converted to planar float */
+static void convert_frames(float *const *dst, enum audio_format format, const struct audio_data *in, size_t channels, size_t src_pos,
+			   size_t frames)
+{
+	switch (format) {
+	case AUDIO_FORMAT_FLOAT:
+		audio_deinterleave_float(dst, (const float *)in->data[0] + src_pos * channels, channels, frames);
+		break;
+	case AUDIO_FORMAT_16BIT:
+		audio_deinterleave_s16(dst, (const int16_t *)in->data[0] + src_pos * channels, channels, frames);
+		break;
+	case AUDIO_FORMAT_32BIT:
+		audio_deinterleave_s32(dst, (const int32_t *)in->data[0] + src_pos * channels, channels, frames);
+		break;
+	default:
+		for (size_t i = 0; i < channels; i++)
+			memcpy(dst[i], (const float *)in->data[i] + src_pos, frames * sizeof(float));
+		break;
+	}
+}
+
+static void copy_frames(struct audio_channel *source, const struct audio_data *in, uint32_t offset, size_t src_pos, size_t frames)
+{
+	float *dst[MAX_AUDIO_CHANNELS];
+
+	for (size_t i = 0; i < source->ring.num_planes; i++)
+		dst[i] = source->ring.planes[i] + offset;
+
+	convert_frames(dst, source->write_format, in, source->ring.num_planes, src_pos, frames);
+}
+
+/* copies the frames in at write_pos, they become visible to the mixer with
+ * the next publish_meta; fails if the mixer is too far behind to take them */
+static bool write_frames(struct audio_channel *source, const struct audio_data *in)
 {
-	size_t buf_placement;
-	size_t channels = get_audio_channels(source->out_sample_info.speakers);
-	size_t size = in->frames * sizeof(float);
+	uint32_t pos = source->pub.write_pos;
+	size_t first;
+
+	if (in->frames > channel_ring_space(&source->ring, pos))
+		return false;
+
+	first = channel_ring_first_run(pos, in->frames);
+	copy_frames(source, in, pos & AUDIO_CHANNEL_RING_MASK, 0, first);
+	if (in->frames > first)
+		copy_frames(source, in, 0, first, in->frames - first);
 
-	if (!source->audio_ts || in->timestamp < source->audio_ts)
-		reset_audio_data(source, in->timestamp);
+	source->pub.write_pos = pos + in->frames;
+	return true;
+}
 
-	buf_placement = get_buf_placement(source->out_sample_info.samples_per_sec, in->timestamp - source->audio_ts) * sizeof(float);
+/* starts a new segment at the packet's timestamp, the mixer lines it up
+ * with whatever is still queued in front of it */
+static void audio_channel_output_audio_place(struct audio_channel *source, const struct audio_data *in)
+{
+	uint32_t pos = source->pub.write_pos;
 
 #if DEBUG_AUDIO == 1
-	blog(LOG_DEBUG, "frames: %lu, size: %lu, placement: %lu, base_ts: %llu, ts: %llu", (unsigned long)in->frames,
-	     (unsigned long)source->audio_input_buf[0].size, (unsigned long)buf_placement, source->audio_ts, in->timestamp);
+	blog(LOG_DEBUG, "frames: %lu, pos: %lu, ts: %llu", (unsigned long)in->frames, (unsigned long)pos, in->timestamp);
 #endif
 
-	/* do not allow the circular buffers to become too big */
-	if ((buf_placement + size) > MAX_BUF_SIZE)
+	/* do not allow the ring to overflow */
+	if (!write_frames(source, in))
 		return;
 
-	for (size_t i = 0; i < channels; i++) {
-		circlebuf_place(&source->audio_input_buf[i], buf_placement, in->data[i], size);
-		circlebuf_pop_back(&source->audio_input_buf[i], NULL, source->audio_input_buf[i].size - (buf_placement + size));
-	}
-
-	source->last_audio_input_buf_size = 0;
+	source->pub.segment++;
+	source->pub.seg_pos = pos;
+	source->pub.seg_ts = in->timestamp;
+	source->has_segment = true;
+	publish_meta(source);
 }
 
 static inline void audio_channel_output_audio_push_back(struct audio_channel *source, const struct audio_data *in)
 {
-	size_t channels = get_audio_channels(source->out_sample_info.speakers);
-	size_t size = in->frames * sizeof(float);
-
-	/* do not allow the circular buffers to become too big */
-	if ((source->audio_input_buf[0].size + size) > MAX_BUF_SIZE)
+	/* do not allow the ring to overflow */
+	if (!write_frames(source, in))
 		return;
 
-	for (size_t i = 0; i < channels; i++)
-		circlebuf_push_back(&source->audio_input_buf[i], in->data[i], size);
+	publish_meta(source);
+}
 
-	/* reset audio input buffer size to ensure that audio doesn't get
-	 * perpetually cut */
-	source->last_audio_input_buf_size = 0;
+/* the new delay goes out with the next write; the mixer shifts the data it
+ * has queued by the difference, so that the following push_backs still land
+ * where they belong */
+static void apply_jitter_delay(struct audio_channel *source)
+{
+	uint64_t delay = jitter_buffer_delay(&source->jitter);
+
+	/* the mixer holds back that much more, or less, data in the ring */
+	if (delay >= source->applied_delay)
+		drift_comp_shift_target(&source->drift, (double)conv_time_to_frames(source, delay - source->applied_delay));
+	else
+		drift_comp_shift_target(&source->drift, -(double)conv_time_to_frames(source, source->applied_delay - delay));
+
+	source->applied_delay = delay;
+	source->pub.delay = source->applied_delay;
 }
 
-static void audio_channel_output_audio_internal(struct audio_channel *source, const struct audio_data *data)
+/* runs the packet through the drift interpolator into drift_scratch, which
+ * leaves it as planar float */
+static void apply_drift(struct audio_channel *source, struct audio_data *in)
+{
+	size_t planes = source->ring.num_planes;
+	size_t max_out = drift_comp_max_output(in->frames);
+	float *src[MAX_AUDIO_CHANNELS];
+	float *dst[MAX_AUDIO_CHANNELS];
+	size_t frames;
+
+	da_resize(source->drift_scratch, (in->frames + max_out) * planes);
+
+	for (size_t i = 0; i < planes; i++) {
+		src[i] = source->drift_scratch.array + i * in->frames;
+		dst[i] = source->drift_scratch.array + planes * in->frames + i * max_out;
+	}
+
+	convert_frames(src, source->write_format, in, planes, 0, in->frames);
+	frames = drift_comp_process(&source->drift, dst, (const float *const *)src, planes, in->frames);
+
+	for (size_t i = 0; i < planes; i++)
+		in->data[i] = (uint8_t *)dst[i];
+	in->frames = (uint32_t)frames;
+	source->write_format = AUDIO_FORMAT_FLOAT_PLANAR;
+}
+
+static void output_direct(struct audio_channel *source, const struct audio_data *in)
+{
+	struct obs_source_audio audio = {0};
+
+	audio.format = source->write_format;
+	audio.samples_per_sec = source->out_sample_info.samples_per_sec;
+	audio.speakers = source->out_sample_info.speakers;
+	audio.frames = in->frames;
+	audio.timestamp = in->timestamp;
+	for (size_t i = 0; i < source->ring.num_planes; i++)
+		audio.data[i] = in->data[i];
+
+	obs_source_output_audio(source->direct_output, &audio);
+}
+
+static void audio_channel_output_audio_internal(struct audio_channel *source, const struct audio_data *data, bool continuous)
 {
 	size_t sample_rate = source->out_sample_info.samples_per_sec;
 	struct audio_data in = *data;
@@ -117,21 +204,28 @@ static void audio_channel_output_audio_internal(struct audio_channel *source, co
 	bool using_direct_ts = false;
 	bool push_back = false;
 
-	/* detects 'directly' set timestamps as long as they're within
-	 * a certain threshold */
-	if (uint64_diff(in.timestamp, os_time) < MAX_TS_VAR) {
-		source->timing_adjust = 0;
-		using_direct_ts = true;
-	}
+	if (continuous && source->next_audio_ts_min != 0) {
+		/* the hook's frame counter says these samples directly follow
+		 * the previous ones, so keep the timeline exact */
+		in.timestamp = source->next_audio_ts_min;
 
-	if (source->next_audio_ts_min != 0) {
-		diff = uint64_diff(source->next_audio_ts_min, in.timestamp);
+	} else {
+		/* detects 'directly' set timestamps as long as they're within
+		 * a certain threshold */
+		if (uint64_diff(in.timestamp, os_time) < MAX_TS_VAR) {
+			source->timing_adjust = 0;
+			using_direct_ts = true;
+		}
 
-		/* smooth audio if within threshold */
-		if (diff > MAX_TS_VAR && !using_direct_ts)
-			handle_ts_jump(source, source->next_audio_ts_min, in.timestamp, diff, os_time);
-		else if (diff < TS_SMOOTHING_THRESHOLD) {
-			in.timestamp = source->next_audio_ts_min;
+		if (source->next_audio_ts_min != 0) {
+			diff = uint64_diff(source->next_audio_ts_min, in.timestamp);
+
+			/* smooth audio if within threshold */
+			if (diff > MAX_TS_VAR && !using_direct_ts)
+				handle_ts_jump(source, source->next_audio_ts_min, in.timestamp, diff, os_time);
+			else if (diff < TS_SMOOTHING_THRESHOLD) {
+				in.timestamp = source->next_audio_ts_min;
+			}
 		}
 	}
 
@@ -140,7 +234,10 @@ static void audio_channel_output_audio_internal(struct audio_channel *source, co
 
 	in.timestamp += source->timing_adjust;
 
-	pthread_mutex_lock(&source->audio_buf_mutex);
+	/* the mixer wants the last sample of this packet at next_audio_ts_min */
+	uint64_t due = source->next_audio_ts_min + source->timing_adjust;
+	if (jitter_buffer_add_sample(&source->jitter, os_time > due ? os_time - due : 0))
+		apply_jitter_delay(source);
 
 	if (source->next_audio_sys_ts_min == in.timestamp) {
 		push_back = true;
@@ -163,34 +260,97 @@ static void audio_channel_output_audio_internal(struct audio_channel *source, co
 		}
 	}
 
-	//add extra 100ms to avoid loss audio data when capture jitter
-	in.timestamp += 100000000;
 	in.timestamp -= source->resample_offset;
 
 	source->next_audio_sys_ts_min = source->next_audio_ts_min + source->timing_adjust;
 
-	if (push_back && source->audio_ts)
+	/* obs buffers a lone source by itself, so it gets no jitter delay */
+	if (source->direct_output) {
+		output_direct(source, &in);
+		return;
+	}
+
+	in.timestamp += source->applied_delay;
+
+	/* the mixer dropped the timeline because the data stalled, so there is
+	 * nothing left to append to */
+	uint32_t resets = channel_ring_resets(&source->ring);
+	if (resets != source->resets_seen) {
+		source->resets_seen = resets;
+		push_back = false;
+	}
+
+	push_back = push_back && source->has_segment;
+
+	/* steer the rate so that the ring stays as full as it was once the
+	 * stream settled */
+	if (!push_back)
+		drift_comp_restart(&source->drift);
+	drift_comp_update(&source->drift, channel_ring_fill(&source->ring, source->pub.write_pos), in.frames, sample_rate);
+	if (drift_comp_active(&source->drift))
+		apply_drift(source, &in);
+
+	if (push_back)
 		audio_channel_output_audio_push_back(source, &in);
 	else
 		audio_channel_output_audio_place(source, &in);
+}
+
+static inline bool is_convert_only(const struct resample_info *in, const struct resample_info *out)
+{
+	if (in->samples_per_sec != out->samples_per_sec || in->speakers != out->speakers)
+		return false;
+
+	switch (in->format) {
+	case AUDIO_FORMAT_FLOAT:
+	case AUDIO_FORMAT_16BIT:
+	case AUDIO_FORMAT_32BIT:
+		return true;
+	case AUDIO_FORMAT_FLOAT_PLANAR:
+		return out->format == AUDIO_FORMAT_FLOAT_PLANAR;
+	default:
+		return false;
+	}
+}
 
-	pthread_mutex_unlock(&source->audio_buf_mutex);
+/* hands the resampler back to the pool, the next packet picks one for its
+ * format again */
+void audio_channel_release_resampler(struct audio_channel *source)
+{
+	resampler_pool_put(source->resamplers, &source->out_sample_info, &source->in_sample_info, source->resampler);
+	source->resampler = NULL;
+	source->convert_only = false;
+	memset(&source->in_sample_info, 0, sizeof(source->in_sample_info));
 }
 
-void audio_channel_output_audio(struct audio_channel *c, struct obs_source_audio *audio)
+void audio_channel_output_audio(struct audio_channel *c, struct obs_source_audio *audio, uint64_t frame_index, bool discontinuity)
 {
+	bool continuous = !discontinuity && c->next_frame_index && frame_index == c->next_frame_index;
+	c->next_frame_index = frame_index + audio->frames;
+
+	if (c->params_changed) {
+		pthread_mutex_lock(&c->params_mutex);
+		jitter_buffer_set_params(&c->jitter, &c->params);
+		c->params_changed = false;
+		pthread_mutex_unlock(&c->params_mutex);
+		apply_jitter_delay(c);
+	}
+
 	if (c->in_sample_info.samples_per_sec != audio->samples_per_sec || c->in_sample_info.format != audio->format ||
 	    c->in_sample_info.speakers != audio->speakers) {
+		audio_channel_release_resampler(c);
+
 		c->in_sample_info.format = audio->format;
 		c->in_sample_info.samples_per_sec = audio->samples_per_sec;
 		c->in_sample_info.speakers = audio->speakers;
 
-		audio_resampler_destroy(c->resampler);
-		c->resampler = NULL;
+		/* same rate and layout only needs the samples split into
+		 * planes, which is done while writing them into the ring */
+		c->convert_only = is_convert_only(&c->in_sample_info, &c->out_sample_info);
+		if (!c->convert_only)
+			c->resampler = resampler_pool_get(c->resamplers, &c->out_sample_info, &c->in_sample_info);
 		c->resample_offset = 0;
-
-		c->resampler = audio_resampler_create(&c->out_sample_info, &c->in_sample_info);
-		blog(LOG_ERROR, "create audio channel resampler: %p", c);
+		continuous = false;
 	}
 
 	struct audio_data out_audio;
@@ -215,33 +375,203 @@ void audio_channel_output_audio(struct audio_channel *c, struct obs_source_audio
 		}
 	}
 
-	audio_channel_output_audio_internal(c, &out_audio);
+	c->write_format = c->convert_only ? c->in_sample_info.format : AUDIO_FORMAT_FLOAT_PLANAR;
+	audio_channel_output_audio_internal(c, &out_audio, continuous);
 }
 
-void audio_channel_pick_audio_data(struct audio_channel *source, size_t size, size_t channels)
+/* leaving direct output, the ring holds nothing that the next packet could
+ * be appended to */
+void audio_channel_set_direct_output(struct audio_channel *source, struct obs_source *output)
 {
-	pthread_mutex_lock(&source->audio_buf_mutex);
+	if (source->direct_output && !output)
+		source->has_segment = false;
+	source->direct_output = output;
+}
 
-	if (source->audio_input_buf[0].size < size) {
+/* ------------------------------------------------------------------------- */
+/* mixer side                                                                */
+
+static inline void release_frames(struct audio_channel *source, uint32_t pos)
+{
+	channel_ring_release(&source->ring, pos);
+}
+
+static void jump_to_segment(struct audio_channel *source, uint32_t pos, uint64_t ts)
+{
+	source->seg_pending = false;
+	source->audio_ts = ts;
+	release_frames(source, pos);
+}
+
+/* once the data queued in front of a pending segment is used up, or its
+ * timeline reached the segment's start, continue with the segment */
+static inline void check_pending_segment(struct audio_channel *source)
+{
+	if (source->seg_pending && !audio_channel_frames(source))
+		jump_to_segment(source, source->pending_pos, source->pending_ts);
+}
+
+/* picks up what the capture thread published since the last tick, or keeps
+ * what it saw before if the capture thread is in the middle of publishing */
+static void sync_meta(struct audio_channel *source)
+{
+	struct audio_channel_meta meta;
+
+	if (!channel_ring_read_meta(&source->ring, &meta)) {
+		check_pending_segment(source);
+		return;
+	}
+	source->seen = meta;
+
+	/* a longer delay moves the queued timeline back, a shorter one drops
+	 * the frames that no longer need to be held */
+	if (meta.delay != source->delay) {
+		if (source->audio_ts) {
+			if (meta.delay > source->delay) {
+				source->audio_ts += meta.delay - source->delay;
+			} else {
+				size_t frames = convert_time_to_frames(source->out_sample_info.samples_per_sec, source->delay - meta.delay);
+				size_t avail = audio_channel_frames(source);
+
+				if (frames > avail)
+					frames = avail;
+				release_frames(source, source->ring.read_pos + (uint32_t)frames);
+			}
+		}
+
+		source->delay = meta.delay;
+	}
+
+	if (meta.segment != source->segment) {
+		/* an older segment was never reached, the data in front of it
+		 * is dropped */
+		if (source->seg_pending)
+			jump_to_segment(source, source->pending_pos, source->pending_ts);
+
+		source->segment = meta.segment;
+
+		if (!source->audio_ts || meta.seg_ts <= source->audio_ts || source->ring.read_pos == meta.seg_pos) {
+			jump_to_segment(source, meta.seg_pos, meta.seg_ts);
+		} else {
+			source->seg_pending = true;
+			source->pending_pos = meta.seg_pos;
+			source->pending_ts = meta.seg_ts;
+		}
+	}
+
+	check_pending_segment(source);
+}
+
+/* flags the channel as pending if it can not fill a whole mix block yet; the
+ * mixer then reads whatever is ready straight out of the ring */
+void audio_channel_poll_audio_data(struct audio_channel *source, size_t frames)
+{
+	sync_meta(source);
+
+	source->audio_pending = audio_channel_frames(source) < frames;
 #if DEBUG_AUDIO == 1
-		blog(LOG_DEBUG, "audio_channel_pick_audio_data: data not enough, current: %d, expected: %d", source->audio_input_buf[0].size, size);
+	if (source->audio_pending)
+		blog(LOG_DEBUG, "audio_channel_poll_audio_data: data not enough, current: %d, expected: %d", (int)audio_channel_frames(source),
+		     (int)frames);
 #endif
-		source->audio_pending = true;
-		pthread_mutex_unlock(&source->audio_buf_mutex);
-		return;
+}
+
+/* frames the mixer can read from audio_ts on, as of the last poll */
+size_t audio_channel_frames(const struct audio_channel *source)
+{
+	uint32_t end = source->seg_pending ? source->pending_pos : source->seen.write_pos;
+	size_t frames;
+
+	if (!source->audio_ts)
+		return 0;
+
+	frames = (size_t)(end - source->ring.read_pos);
+
+	if (source->seg_pending) {
+		size_t until = 0;
+		if (source->pending_ts > source->audio_ts)
+			until = convert_time_to_frames(source->out_sample_info.samples_per_sec, source->pending_ts - source->audio_ts);
+		if (until < frames)
+			frames = until;
 	}
 
-	for (size_t ch = 0; ch < channels; ch++)
-		circlebuf_peek_front(&source->audio_input_buf[ch], source->audio_output_buf[ch], size);
+	return frames;
+}
+
+/* whether the capture thread has published at least frames to read, without
+ * touching the pending state of the current tick */
+bool audio_channel_ready(struct audio_channel *source, size_t frames)
+{
+	sync_meta(source);
+	return audio_channel_frames(source) >= frames;
+}
 
-	pthread_mutex_unlock(&source->audio_buf_mutex);
-	source->audio_pending = false;
+/* the span points into the ring and stays valid until the frames are
+ * consumed, the capture thread never writes over unconsumed frames */
+void audio_channel_peek_span(struct audio_channel *source, size_t ch, size_t frames, struct audio_span *span)
+{
+	size_t avail = audio_channel_frames(source);
+
+	if (frames > avail)
+		frames = avail;
+
+	channel_ring_peek(&source->ring, ch, frames, span);
+}
+
+/* hands frames back to the capture thread, audio_ts is the timestamp of the
+ * first frame left */
+void audio_channel_consume(struct audio_channel *source, size_t frames, uint64_t audio_ts)
+{
+	release_frames(source, source->ring.read_pos + (uint32_t)frames);
+	source->audio_ts = audio_ts;
+	check_pending_segment(source);
+}
+
+/* drops everything queued and the timeline with it, the capture thread then
+ * starts a new segment with its next packet */
+void audio_channel_clear(struct audio_channel *source)
+{
+	source->seg_pending = false;
+	source->audio_ts = 0;
+	channel_ring_clear(&source->ring, source->seen.write_pos);
+}
+
+/* timestamp just past the last readable frame, or 0 if the channel has no
+ * timeline yet */
+uint64_t audio_channel_buffered_end(struct audio_channel *source, size_t sample_rate)
+{
+	if (!source->audio_ts)
+		return 0;
+
+	return source->audio_ts + conv_frames_to_time(sample_rate, audio_channel_frames(source));
+}
+
+/* drops the frames in front of ts so the channel lines up with a mix window
+ * that was moved forward, crossfading over up to fade_frames after the cut */
+void audio_channel_skip_to(struct audio_channel *source, size_t sample_rate, uint64_t ts, size_t fade_frames)
+{
+	size_t frames;
+	size_t avail;
+
+	if (!source->audio_ts || source->audio_ts >= ts)
+		return;
+
+	frames = convert_time_to_frames(sample_rate, ts - source->audio_ts);
+	avail = audio_channel_frames(source);
+	if (frames > avail)
+		frames = avail;
+
+	if (fade_frames > avail - frames)
+		fade_frames = avail - frames;
+	if (frames && fade_frames)
+		channel_ring_crossfade(&source->ring, frames, fade_frames);
+
+	audio_channel_consume(source, frames, ts);
 }
 
 bool audio_channel_audio_buffer_insuffient(struct audio_channel *source, size_t sample_rate, uint64_t min_ts)
 {
 	size_t total_floats = AUDIO_OUTPUT_FRAMES;
-	size_t size;
 
 	if (source->audio_pending || !source->audio_ts) {
 		return false;
@@ -255,9 +585,7 @@ bool audio_channel_audio_buffer_insuffient(struct audio_channel *source, size_t
 		total_floats -= start_point;
 	}
 
-	size = total_floats * sizeof(float);
-
-	if (source->audio_input_buf[0].size < size) {
+	if (audio_channel_frames(source) < total_floats) {
 		source->audio_pending = true;
 		return true;
 	}
@@ -265,30 +593,84 @@ bool audio_channel_audio_buffer_insuffient(struct audio_channel *source, size_t
 	return false;
 }
 
-struct audio_channel *audio_channel_create(struct resample_info *info)
+/* ------------------------------------------------------------------------- */
+
+struct audio_channel *audio_channel_create(struct resample_info *info, const struct jitter_params *params, struct resampler_pool *resamplers)
 {
 	struct audio_channel *channel = bzalloc(sizeof(*channel));
 	memcpy(&channel->out_sample_info, info, sizeof(struct resample_info));
-	pthread_mutex_init_value(&channel->audio_buf_mutex);
-	pthread_mutex_init(&channel->audio_buf_mutex, NULL);
+	channel->resamplers = resamplers;
+
+	channel->ring.num_planes = get_audio_channels(info->speakers);
+	channel_arena_init(&channel->arena, channel->ring.num_planes * channel_arena_block_size(RING_BYTES));
+	for (size_t i = 0; i < channel->ring.num_planes; i++)
+		channel->ring.planes[i] = channel_arena_alloc(&channel->arena, RING_BYTES);
+
+	jitter_buffer_init(&channel->jitter, params);
+	drift_comp_init(&channel->drift);
+	da_init(channel->drift_scratch);
+	channel->params = *params;
+	apply_jitter_delay(channel);
+	channel->delay = channel->pub.delay;
+	channel_ring_reset(&channel->ring, &channel->pub);
+	pthread_mutex_init_value(&channel->params_mutex);
+	pthread_mutex_init(&channel->params_mutex, NULL);
+	return channel;
+}
 
-	size_t size = sizeof(float) * AUDIO_OUTPUT_FRAMES * MAX_AUDIO_CHANNELS;
-	float *ptr = bzalloc(size);
+void audio_channel_set_jitter_params(struct audio_channel *source, const struct jitter_params *params)
+{
+	pthread_mutex_lock(&source->params_mutex);
+	source->params = *params;
+	source->params_changed = true;
+	pthread_mutex_unlock(&source->params_mutex);
+}
 
-	for (size_t i = 0; i < MAX_AUDIO_CHANNELS; i++) {
-		channel->audio_output_buf[i] = ptr + sizeof(float) * AUDIO_OUTPUT_FRAMES * i;
-	}
+/* puts a channel that was taken out of the mix back into its freshly created
+ * state, keeping the ring allocation so it can be handed out again.  neither
+ * thread may be using the channel */
+void audio_channel_reset(struct audio_channel *source, const struct jitter_params *params)
+{
+	audio_channel_release_resampler(source);
 
-	return channel;
+	memset(&source->pub, 0, sizeof(source->pub));
+	memset(&source->seen, 0, sizeof(source->seen));
+	source->resets_seen = 0;
+	source->has_segment = false;
+	source->segment = 0;
+	source->seg_pending = false;
+
+	source->audio_pending = false;
+	source->pending_stop = false;
+	source->audio_ts = 0;
+	source->last_write_pos = 0;
+	source->timing_adjust = 0;
+	source->resample_offset = 0;
+	source->last_audio_ts = 0;
+	source->next_audio_ts_min = 0;
+	source->next_audio_sys_ts_min = 0;
+	source->last_frame_ts = 0;
+	source->last_sys_timestamp = 0;
+	source->next_frame_index = 0;
+	source->last_input_time = 0;
+	source->direct_output = NULL;
+
+	jitter_buffer_init(&source->jitter, params);
+	drift_comp_init(&source->drift);
+	source->applied_delay = 0;
+	source->params = *params;
+	source->params_changed = false;
+	apply_jitter_delay(source);
+	source->delay = source->pub.delay;
+	channel_ring_reset(&source->ring, &source->pub);
 }
 
 void audio_channel_destroy(struct audio_channel *source)
 {
-	for (size_t i = 0; i < MAX_AUDIO_CHANNELS; i++)
-		circlebuf_free(&source->audio_input_buf[i]);
+	channel_arena_free(&source->arena);
+	da_free(source->drift_scratch);
 
 	audio_resampler_destroy(source->resampler);
-	bfree(source->audio_output_buf[0]);
-	pthread_mutex_destroy(&source->audio_buf_mutex);
+	pthread_mutex_destroy(&source->params_mutex);
 	bfree(source);
 }
@@ -1,16 +1,40 @@
 #pragma once
 
 #include <media-io/audio-resampler.h>
-#include <util/circlebuf.h>
 #include <pthread.h>
+#include <util/darray.h>
+#include "jitter-buffer.h"
+#include "drift-comp.h"
+#include "resampler-pool.h"
+#include "channel-arena.h"
+#include "channel-ring.h"
 
+/* the capture thread is the only producer and the mix thread the only
+ * consumer of a channel, its samples go through ring */
 struct audio_channel {
+	/* ---------------------------------------------------------------- */
+	/* shared */
+	struct channel_ring ring;
+	struct channel_arena arena;
+
+	/* ---------------------------------------------------------------- */
+	/* mixer side */
 	bool audio_pending;
 	bool pending_stop;
 	uint64_t audio_ts;
-	struct circlebuf audio_input_buf[MAX_AUDIO_CHANNELS];
-	size_t last_audio_input_buf_size;
+	uint32_t last_write_pos;
+
+	struct audio_channel_meta seen;
+	uint32_t segment;
+	uint64_t delay;
+
+	/* a segment that starts after the data still queued in front of it */
+	bool seg_pending;
+	uint32_t pending_pos;
+	uint64_t pending_ts;
 
+	/* ---------------------------------------------------------------- */
+	/* capture side */
 	volatile uint64_t timing_adjust;
 	uint64_t resample_offset;
 	uint64_t last_audio_ts;
@@ -18,14 +42,40 @@ struct audio_channel {
 	uint64_t next_audio_sys_ts_min;
 	uint64_t last_frame_ts;
 	uint64_t last_sys_timestamp;
+	uint64_t next_frame_index;
+
+	struct audio_channel_meta pub;
+	uint32_t resets_seen;
+	bool has_segment;
+
+	struct jitter_buffer jitter;
+	uint64_t applied_delay;
+
+	struct drift_comp drift;
+	DARRAY(float) drift_scratch;
 
-	float *audio_output_buf[MAX_AUDIO_CHANNELS];
+	/* format of the packet on its way into the ring, interleaved only on
+	 * the convert_only path */
+	enum audio_format write_format;
+
+	/* new parameters from the settings, picked up by the capture side */
+	pthread_mutex_t params_mutex;
+	struct jitter_params params;
+	volatile bool params_changed;
+
+	/* os time of the last packet, used by the capture thread to evict
+	 * streams the target stopped feeding */
+	uint64_t last_input_time;
+
+	/* while set, resampled packets go straight to this source with their
+	 * own timestamps instead of into the ring */
+	struct obs_source *direct_output;
 
 	struct resample_info in_sample_info;
 	struct resample_info out_sample_info;
 	audio_resampler_t *resampler;
-
-	pthread_mutex_t audio_buf_mutex;
+	struct resampler_pool *resamplers;
+	bool convert_only;
 };
 
 inline size_t convert_time_to_frames(size_t sample_rate, uint64_t t)
@@ -33,8 +83,23 @@ inline size_t convert_time_to_frames(size_t sample_rate, uint64_t t)
 	return (size_t)(t * (uint64_t)sample_rate / 1000000000ULL);
 }
 
-struct audio_channel *audio_channel_create(struct resample_info *info);
+struct audio_channel *audio_channel_create(struct resample_info *info, const struct jitter_params *params, struct resampler_pool *resamplers);
+void audio_channel_set_jitter_params(struct audio_channel *source, const struct jitter_params *params);
+void audio_channel_reset(struct audio_channel *source, const struct jitter_params *params);
 void audio_channel_destroy(struct audio_channel *source);
-void audio_channel_output_audio(struct audio_channel *c, struct obs_source_audio *audio);
-void audio_channel_pick_audio_data(struct audio_channel *source, size_t size, size_t channels);
+
+/* capture thread */
+void audio_channel_output_audio(struct audio_channel *c, struct obs_source_audio *audio, uint64_t frame_index, bool discontinuity);
+void audio_channel_release_resampler(struct audio_channel *source);
+void audio_channel_set_direct_output(struct audio_channel *source, struct obs_source *output);
+
+/* mix thread */
+void audio_channel_poll_audio_data(struct audio_channel *source, size_t frames);
+size_t audio_channel_frames(const struct audio_channel *source);
+bool audio_channel_ready(struct audio_channel *source, size_t frames);
+void audio_channel_peek_span(struct audio_channel *source, size_t ch, size_t frames, struct audio_span *span);
+void audio_channel_consume(struct audio_channel *source, size_t frames, uint64_t audio_ts);
+void audio_channel_clear(struct audio_channel *source);
+uint64_t audio_channel_buffered_end(struct audio_channel *source, size_t sample_rate);
+void audio_channel_skip_to(struct audio_channel *source, size_t sample_rate, uint64_t ts, size_t fade_frames);
 bool audio_channel_audio_buffer_insuffient(struct audio_channel *source, size_t sample_rate, uint64_t min_ts);
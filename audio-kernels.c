@@ -0,0 +1,403 @@
+#include "audio-kernels.h"
+#include "cpu-features.h"
+
+#if CPU_FEATURES_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#if CPU_FEATURES_X86 && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define TARGET_AVX2
+#define TARGET_SSE2
+#endif
+
+static void mix_float_scalar(float *dst, const float *src, size_t count)
+{
+	register float *mix = dst;
+	register const float *aud = src;
+	register const float *end = src + count;
+
+	while (aud < end)
+		*(mix++) += *(aud++);
+}
+
+static void mix_s16_scalar(int16_t *dst, const int16_t *src, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		int32_t val = (int32_t)dst[i] + (int32_t)src[i];
+		dst[i] = (int16_t)(val > INT16_MAX ? INT16_MAX : val < INT16_MIN ? INT16_MIN : val);
+	}
+}
+
+static void mix_s32_scalar(int32_t *dst, const int32_t *src, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		int64_t val = (int64_t)dst[i] + (int64_t)src[i];
+		dst[i] = (int32_t)(val > INT32_MAX ? INT32_MAX : val < INT32_MIN ? INT32_MIN : val);
+	}
+}
+
+/* samples [begin, count) of the fused mix, also used for the simd tails */
+static inline void mix_fused_range(float *dst, const float *const *src, size_t num_src, size_t begin, size_t count)
+{
+	for (size_t i = begin; i < count; i++) {
+		float val = 0.0f;
+
+		for (size_t s = 0; s < num_src; s++)
+			val += src[s][i];
+
+		val = (val > 1.0f) ? 1.0f : val;
+		val = (val < -1.0f) ? -1.0f : val;
+		dst[i] = val;
+	}
+}
+
+static void mix_fused_scalar(float *dst, const float *const *src, size_t num_src, size_t count)
+{
+	mix_fused_range(dst, src, num_src, 0, count);
+}
+
+/* frames [begin, frames) of a deinterleave, also used for the simd tails */
+#define DEINTERLEAVE_RANGE(name, type, scale)                                                                          \
+	static inline void name(float *const *dst, const type *src, size_t channels, size_t begin, size_t frames)     \
+	{                                                                                                              \
+		const type *in = src + begin * channels;                                                               \
+		for (size_t i = begin; i < frames; i++) {                                                              \
+			for (size_t c = 0; c < channels; c++)                                                          \
+				dst[c][i] = (float)*(in++) * (scale);                                                  \
+		}                                                                                                      \
+	}
+
+DEINTERLEAVE_RANGE(deinterleave_float_range, float, 1.0f)
+DEINTERLEAVE_RANGE(deinterleave_s16_range, int16_t, 1.0f / 32768.0f)
+DEINTERLEAVE_RANGE(deinterleave_s32_range, int32_t, 1.0f / 2147483648.0f)
+
+static void deinterleave_float_scalar(float *const *dst, const float *src, size_t channels, size_t frames)
+{
+	deinterleave_float_range(dst, src, channels, 0, frames);
+}
+
+static void deinterleave_s16_scalar(float *const *dst, const int16_t *src, size_t channels, size_t frames)
+{
+	deinterleave_s16_range(dst, src, channels, 0, frames);
+}
+
+static void deinterleave_s32_scalar(float *const *dst, const int32_t *src, size_t channels, size_t frames)
+{
+	deinterleave_s32_range(dst, src, channels, 0, frames);
+}
+
+#if CPU_FEATURES_X86
+/* the mix buffers are aligned but the channel data is a view into a
+ * circlebuf, so both sides use unaligned loads */
+TARGET_SSE2 static void mix_float_sse2(float *dst, const float *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m128 a0 = _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i));
+		__m128 a1 = _mm_add_ps(_mm_loadu_ps(dst + i + 4), _mm_loadu_ps(src + i + 4));
+		_mm_storeu_ps(dst + i, a0);
+		_mm_storeu_ps(dst + i + 4, a1);
+	}
+
+	mix_float_scalar(dst + i, src + i, count - i);
+}
+
+TARGET_SSE2 static void mix_fused_sse2(float *dst, const float *const *src, size_t num_src, size_t count)
+{
+	const __m128 lo = _mm_set1_ps(-1.0f);
+	const __m128 hi = _mm_set1_ps(1.0f);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m128 a0 = _mm_setzero_ps();
+		__m128 a1 = _mm_setzero_ps();
+
+		for (size_t s = 0; s < num_src; s++) {
+			a0 = _mm_add_ps(a0, _mm_loadu_ps(src[s] + i));
+			a1 = _mm_add_ps(a1, _mm_loadu_ps(src[s] + i + 4));
+		}
+
+		_mm_storeu_ps(dst + i, _mm_min_ps(_mm_max_ps(a0, lo), hi));
+		_mm_storeu_ps(dst + i + 4, _mm_min_ps(_mm_max_ps(a1, lo), hi));
+	}
+
+	mix_fused_range(dst, src, num_src, i, count);
+}
+
+TARGET_SSE2 static void mix_s16_sse2(int16_t *dst, const int16_t *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m128i a0 = _mm_adds_epi16(_mm_loadu_si128((const __m128i *)(dst + i)), _mm_loadu_si128((const __m128i *)(src + i)));
+		__m128i a1 = _mm_adds_epi16(_mm_loadu_si128((const __m128i *)(dst + i + 8)), _mm_loadu_si128((const __m128i *)(src + i + 8)));
+		_mm_storeu_si128((__m128i *)(dst + i), a0);
+		_mm_storeu_si128((__m128i *)(dst + i + 8), a1);
+	}
+
+	mix_s16_scalar(dst + i, src + i, count - i);
+}
+
+/* there is no saturating 32 bit add: the sum overflowed where both inputs
+ * have the same sign and the result does not, and then saturates towards
+ * the sign of the inputs */
+TARGET_SSE2 static inline __m128i adds_epi32_sse2(__m128i a, __m128i b)
+{
+	__m128i sum = _mm_add_epi32(a, b);
+	__m128i overflow = _mm_srai_epi32(_mm_andnot_si128(_mm_xor_si128(a, b), _mm_xor_si128(a, sum)), 31);
+	__m128i limit = _mm_xor_si128(_mm_srai_epi32(a, 31), _mm_set1_epi32(INT32_MAX));
+	return _mm_or_si128(_mm_and_si128(overflow, limit), _mm_andnot_si128(overflow, sum));
+}
+
+TARGET_SSE2 static void mix_s32_sse2(int32_t *dst, const int32_t *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m128i a0 = adds_epi32_sse2(_mm_loadu_si128((const __m128i *)(dst + i)), _mm_loadu_si128((const __m128i *)(src + i)));
+		__m128i a1 = adds_epi32_sse2(_mm_loadu_si128((const __m128i *)(dst + i + 4)), _mm_loadu_si128((const __m128i *)(src + i + 4)));
+		_mm_storeu_si128((__m128i *)(dst + i), a0);
+		_mm_storeu_si128((__m128i *)(dst + i + 4), a1);
+	}
+
+	mix_s32_scalar(dst + i, src + i, count - i);
+}
+
+/* a = L0 R0 L1 R1, b = L2 R2 L3 R3 */
+TARGET_SSE2 static inline void store_stereo_sse2(float *left, float *right, __m128 a, __m128 b)
+{
+	_mm_storeu_ps(left, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+	_mm_storeu_ps(right, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+/* sign extends four int16 from the low or high half of x */
+#define S16_LO_TO_PS(x) _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16))
+#define S16_HI_TO_PS(x) _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16))
+
+/* mono and stereo cover nearly every stream, wider layouts stay scalar */
+TARGET_SSE2 static void deinterleave_float_sse2(float *const *dst, const float *src, size_t channels, size_t frames)
+{
+	size_t i = 0;
+
+	if (channels == 2) {
+		for (; i + 4 <= frames; i += 4)
+			store_stereo_sse2(dst[0] + i, dst[1] + i, _mm_loadu_ps(src + i * 2), _mm_loadu_ps(src + i * 2 + 4));
+	} else if (channels == 1) {
+		for (; i + 4 <= frames; i += 4)
+			_mm_storeu_ps(dst[0] + i, _mm_loadu_ps(src + i));
+	}
+
+	deinterleave_float_range(dst, src, channels, i, frames);
+}
+
+TARGET_SSE2 static void deinterleave_s16_sse2(float *const *dst, const int16_t *src, size_t channels, size_t frames)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+	size_t i = 0;
+
+	if (channels == 2) {
+		for (; i + 4 <= frames; i += 4) {
+			__m128i x = _mm_loadu_si128((const __m128i *)(src + i * 2));
+			store_stereo_sse2(dst[0] + i, dst[1] + i, _mm_mul_ps(S16_LO_TO_PS(x), scale), _mm_mul_ps(S16_HI_TO_PS(x), scale));
+		}
+	} else if (channels == 1) {
+		for (; i + 8 <= frames; i += 8) {
+			__m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+			_mm_storeu_ps(dst[0] + i, _mm_mul_ps(S16_LO_TO_PS(x), scale));
+			_mm_storeu_ps(dst[0] + i + 4, _mm_mul_ps(S16_HI_TO_PS(x), scale));
+		}
+	}
+
+	deinterleave_s16_range(dst, src, channels, i, frames);
+}
+
+TARGET_SSE2 static void deinterleave_s32_sse2(float *const *dst, const int32_t *src, size_t channels, size_t frames)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+	size_t i = 0;
+
+	if (channels == 2) {
+		for (; i + 4 <= frames; i += 4) {
+			__m128 a = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(src + i * 2)));
+			__m128 b = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(src + i * 2 + 4)));
+			store_stereo_sse2(dst[0] + i, dst[1] + i, _mm_mul_ps(a, scale), _mm_mul_ps(b, scale));
+		}
+	} else if (channels == 1) {
+		for (; i + 4 <= frames; i += 4) {
+			__m128 a = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(src + i)));
+			_mm_storeu_ps(dst[0] + i, _mm_mul_ps(a, scale));
+		}
+	}
+
+	deinterleave_s32_range(dst, src, channels, i, frames);
+}
+
+TARGET_AVX2 static void mix_float_avx2(float *dst, const float *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m256 a0 = _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i));
+		__m256 a1 = _mm256_add_ps(_mm256_loadu_ps(dst + i + 8), _mm256_loadu_ps(src + i + 8));
+		_mm256_storeu_ps(dst + i, a0);
+		_mm256_storeu_ps(dst + i + 8, a1);
+	}
+
+	/* avoid the avx/sse transition penalty before the scalar tail */
+	_mm256_zeroupper();
+	mix_float_scalar(dst + i, src + i, count - i);
+}
+
+TARGET_AVX2 static void mix_s16_avx2(int16_t *dst, const int16_t *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 32 <= count; i += 32) {
+		__m256i a0 = _mm256_adds_epi16(_mm256_loadu_si256((const __m256i *)(dst + i)), _mm256_loadu_si256((const __m256i *)(src + i)));
+		__m256i a1 = _mm256_adds_epi16(_mm256_loadu_si256((const __m256i *)(dst + i + 16)),
+					       _mm256_loadu_si256((const __m256i *)(src + i + 16)));
+		_mm256_storeu_si256((__m256i *)(dst + i), a0);
+		_mm256_storeu_si256((__m256i *)(dst + i + 16), a1);
+	}
+
+	_mm256_zeroupper();
+	mix_s16_scalar(dst + i, src + i, count - i);
+}
+
+TARGET_AVX2 static inline __m256i adds_epi32_avx2(__m256i a, __m256i b)
+{
+	__m256i sum = _mm256_add_epi32(a, b);
+	__m256i overflow = _mm256_srai_epi32(_mm256_andnot_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, sum)), 31);
+	__m256i limit = _mm256_xor_si256(_mm256_srai_epi32(a, 31), _mm256_set1_epi32(INT32_MAX));
+	return _mm256_blendv_epi8(sum, limit, overflow);
+}
+
+TARGET_AVX2 static void mix_s32_avx2(int32_t *dst, const int32_t *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m256i a0 = adds_epi32_avx2(_mm256_loadu_si256((const __m256i *)(dst + i)), _mm256_loadu_si256((const __m256i *)(src + i)));
+		__m256i a1 = adds_epi32_avx2(_mm256_loadu_si256((const __m256i *)(dst + i + 8)),
+					     _mm256_loadu_si256((const __m256i *)(src + i + 8)));
+		_mm256_storeu_si256((__m256i *)(dst + i), a0);
+		_mm256_storeu_si256((__m256i *)(dst + i + 8), a1);
+	}
+
+	_mm256_zeroupper();
+	mix_s32_scalar(dst + i, src + i, count - i);
+}
+
+/* the inner loop walks the sources so the partial sums of a block stay in
+ * registers */
+TARGET_AVX2 static void mix_fused_avx2(float *dst, const float *const *src, size_t num_src, size_t count)
+{
+	const __m256 lo = _mm256_set1_ps(-1.0f);
+	const __m256 hi = _mm256_set1_ps(1.0f);
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m256 a0 = _mm256_setzero_ps();
+		__m256 a1 = _mm256_setzero_ps();
+
+		for (size_t s = 0; s < num_src; s++) {
+			a0 = _mm256_add_ps(a0, _mm256_loadu_ps(src[s] + i));
+			a1 = _mm256_add_ps(a1, _mm256_loadu_ps(src[s] + i + 8));
+		}
+
+		_mm256_storeu_ps(dst + i, _mm256_min_ps(_mm256_max_ps(a0, lo), hi));
+		_mm256_storeu_ps(dst + i + 8, _mm256_min_ps(_mm256_max_ps(a1, lo), hi));
+	}
+
+	_mm256_zeroupper();
+	mix_fused_range(dst, src, num_src, i, count);
+}
+#endif
+
+audio_mix_float_t audio_mix_float = mix_float_scalar;
+audio_mix_s16_t audio_mix_s16 = mix_s16_scalar;
+audio_mix_s32_t audio_mix_s32 = mix_s32_scalar;
+audio_mix_fused_t audio_mix_fused = mix_fused_scalar;
+audio_deinterleave_float_t audio_deinterleave_float = deinterleave_float_scalar;
+audio_deinterleave_s16_t audio_deinterleave_s16 = deinterleave_s16_scalar;
+audio_deinterleave_s32_t audio_deinterleave_s32 = deinterleave_s32_scalar;
+
+static enum audio_kernel_level cpu_kernel_level(void)
+{
+#if CPU_FEATURES_X86
+	if (cpu_check_4th_gen_intel_core_features())
+		return AUDIO_KERNEL_AVX2;
+	if (cpu_has_sse2())
+		return AUDIO_KERNEL_SSE2;
+#endif
+	return AUDIO_KERNEL_SCALAR;
+}
+
+enum audio_kernel_level audio_kernels_init(void)
+{
+	return audio_kernels_select(AUDIO_KERNEL_AVX2);
+}
+
+enum audio_kernel_level audio_kernels_select(enum audio_kernel_level max_level)
+{
+	enum audio_kernel_level level = cpu_kernel_level();
+
+	if (level > max_level)
+		level = max_level;
+
+	switch (level) {
+#if CPU_FEATURES_X86
+	case AUDIO_KERNEL_AVX2:
+		audio_mix_float = mix_float_avx2;
+		audio_mix_s16 = mix_s16_avx2;
+		audio_mix_s32 = mix_s32_avx2;
+		audio_mix_fused = mix_fused_avx2;
+		break;
+	case AUDIO_KERNEL_SSE2:
+		audio_mix_float = mix_float_sse2;
+		audio_mix_s16 = mix_s16_sse2;
+		audio_mix_s32 = mix_s32_sse2;
+		audio_mix_fused = mix_fused_sse2;
+		break;
+#endif
+	default:
+		audio_mix_float = mix_float_scalar;
+		audio_mix_s16 = mix_s16_scalar;
+		audio_mix_s32 = mix_s32_scalar;
+		audio_mix_fused = mix_fused_scalar;
+		break;
+	}
+
+	/* the deinterleave shuffles do not gain from 256 bit lanes */
+#if CPU_FEATURES_X86
+	if (level >= AUDIO_KERNEL_SSE2) {
+		audio_deinterleave_float = deinterleave_float_sse2;
+		audio_deinterleave_s16 = deinterleave_s16_sse2;
+		audio_deinterleave_s32 = deinterleave_s32_sse2;
+	} else
+#endif
+	{
+		audio_deinterleave_float = deinterleave_float_scalar;
+		audio_deinterleave_s16 = deinterleave_s16_scalar;
+		audio_deinterleave_s32 = deinterleave_s32_scalar;
+	}
+
+	return level;
+}
+
+const char *audio_kernel_level_name(enum audio_kernel_level level)
+{
+	switch (level) {
+	case AUDIO_KERNEL_AVX2:
+		return "avx2";
+	case AUDIO_KERNEL_SSE2:
+		return "sse2";
+	default:
+		return "scalar";
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+/* inner loops of the mixer, picked once at load time for the best
+ * instruction set the cpu supports.  no libobs dependency so the hook can
+ * share them */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum audio_kernel_level {
+	AUDIO_KERNEL_SCALAR,
+	AUDIO_KERNEL_SSE2,
+	AUDIO_KERNEL_AVX2,
+};
+
+/* dst[i] += src[i] for count floats, no alignment requirements */
+typedef void (*audio_mix_float_t)(float *dst, const float *src, size_t count);
+
+/* dst[i] = saturate(dst[i] + src[i]) for count interleaved integer samples,
+ * no alignment requirements.  nothing that is built mixes integer pcm yet,
+ * they are kept tested for a hook side pre-mix */
+typedef void (*audio_mix_s16_t)(int16_t *dst, const int16_t *src, size_t count);
+typedef void (*audio_mix_s32_t)(int32_t *dst, const int32_t *src, size_t count);
+
+/* dst[i] = clamp(sum of src[s][i], -1, 1) for count floats, so every output
+ * sample is written exactly once; with no sources it writes silence */
+typedef void (*audio_mix_fused_t)(float *dst, const float *const *src, size_t num_src, size_t count);
+
+/* dst[c][i] = src[i * channels + c] as float, integer samples scaled to
+ * [-1, 1); splits an interleaved packet into planes */
+typedef void (*audio_deinterleave_float_t)(float *const *dst, const float *src, size_t channels, size_t frames);
+typedef void (*audio_deinterleave_s16_t)(float *const *dst, const int16_t *src, size_t channels, size_t frames);
+typedef void (*audio_deinterleave_s32_t)(float *const *dst, const int32_t *src, size_t channels, size_t frames);
+
+extern audio_mix_float_t audio_mix_float;
+extern audio_mix_s16_t audio_mix_s16;
+extern audio_mix_s32_t audio_mix_s32;
+extern audio_mix_fused_t audio_mix_fused;
+extern audio_deinterleave_float_t audio_deinterleave_float;
+extern audio_deinterleave_s16_t audio_deinterleave_s16;
+extern audio_deinterleave_s32_t audio_deinterleave_s32;
+
+/* selects the kernels, safe to call more than once; the scalar versions are
+ * used until it has been called */
+enum audio_kernel_level audio_kernels_init(void);
+
+/* like audio_kernels_init but never above max_level, so the tests and
+ * benchmarks can compare every level the cpu supports */
+enum audio_kernel_level audio_kernels_select(enum audio_kernel_level max_level);
+const char *audio_kernel_level_name(enum audio_kernel_level level);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,201 @@
+#pragma once
+
+/* Single-producer/single-consumer ring of variable sized records.
+ *
+ * The cursors and the data area may live in memory shared between two
+ * processes (the hook writes, the plugin reads), so this header must not
+ * depend on libobs or windows.h.  Both cursors are free running byte
+ * counters; the position inside the data area is the counter masked by
+ * the capacity, which therefore has to be a power of two.
+ *
+ * A record never straddles the end of the data area: if it does not fit
+ * in the tail space the producer writes a wrap marker and places the
+ * record at offset 0, so the consumer can always read it in place. */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AUDIO_RING_CACHE_LINE 64
+#define AUDIO_RING_RECORD_ALIGN 8
+#define AUDIO_RING_WRAP_MARKER 0xFFFFFFFFU
+
+#define AUDIO_RING_ALIGN_SIZE(size) (((size) + (AUDIO_RING_RECORD_ALIGN - 1)) & ~(uint32_t)(AUDIO_RING_RECORD_ALIGN - 1))
+
+/* head is only written by the producer and tail only by the consumer, each
+ * on its own cache line so the two sides never false share */
+struct audio_ring_cursors {
+	volatile uint32_t head;
+	uint8_t head_pad[AUDIO_RING_CACHE_LINE - sizeof(uint32_t)];
+	volatile uint32_t tail;
+	uint8_t tail_pad[AUDIO_RING_CACHE_LINE - sizeof(uint32_t)];
+};
+
+struct audio_ring_record {
+	uint32_t size;
+	uint32_t reserved;
+};
+
+/* process local view of a ring, one per side */
+struct audio_ring {
+	struct audio_ring_cursors *cursors;
+	uint8_t *data;
+	uint32_t capacity;
+	uint32_t pending;
+};
+
+/* x86 and x64 are TSO, so plain volatile accesses fenced against compiler
+ * reordering are enough for acquire/release on msvc */
+static inline uint32_t audio_ring_load_acquire(const volatile uint32_t *ptr)
+{
+#if defined(_MSC_VER)
+	uint32_t val = *ptr;
+	_ReadWriteBarrier();
+	return val;
+#else
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void audio_ring_store_release(volatile uint32_t *ptr, uint32_t val)
+{
+#if defined(_MSC_VER)
+	_ReadWriteBarrier();
+	*ptr = val;
+#else
+	__atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+#endif
+}
+
+/* orders the plain loads before it against the loads after it */
+static inline void audio_ring_fence_acquire(void)
+{
+#if defined(_MSC_VER)
+	_ReadWriteBarrier();
+#else
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+#endif
+}
+
+/* orders the stores before it against the stores after it */
+static inline void audio_ring_fence_release(void)
+{
+#if defined(_MSC_VER)
+	_ReadWriteBarrier();
+#else
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+#endif
+}
+
+static inline bool audio_ring_capacity_valid(uint32_t capacity)
+{
+	return capacity >= AUDIO_RING_RECORD_ALIGN * 2 && (capacity & (capacity - 1)) == 0;
+}
+
+static inline void audio_ring_reset(struct audio_ring_cursors *cursors)
+{
+	cursors->head = 0;
+	cursors->tail = 0;
+}
+
+static inline void audio_ring_attach(struct audio_ring *ring, struct audio_ring_cursors *cursors, uint8_t *data, uint32_t capacity)
+{
+	ring->cursors = cursors;
+	ring->data = data;
+	ring->capacity = capacity;
+	ring->pending = 0;
+}
+
+static inline uint32_t audio_ring_used(const struct audio_ring *ring)
+{
+	return audio_ring_load_acquire(&ring->cursors->head) - audio_ring_load_acquire(&ring->cursors->tail);
+}
+
+/* ------------------------------------------------------------------------- */
+/* producer side                                                             */
+
+/* returns a pointer to size bytes of contiguous payload space, or NULL if the
+ * ring is too full; the record becomes visible on audio_ring_commit */
+static inline void *audio_ring_reserve(struct audio_ring *ring, uint32_t size)
+{
+	uint32_t need = AUDIO_RING_ALIGN_SIZE((uint32_t)sizeof(struct audio_ring_record) + size);
+	uint32_t head = ring->cursors->head;
+	uint32_t tail = audio_ring_load_acquire(&ring->cursors->tail);
+	uint32_t pos = head & (ring->capacity - 1);
+	uint32_t to_end = ring->capacity - pos;
+	uint32_t skip = need > to_end ? to_end : 0;
+	struct audio_ring_record *record;
+
+	if (need > ring->capacity || need + skip > ring->capacity - (head - tail))
+		return NULL;
+
+	if (skip) {
+		record = (struct audio_ring_record *)(ring->data + pos);
+		record->size = AUDIO_RING_WRAP_MARKER;
+		pos = 0;
+	}
+
+	record = (struct audio_ring_record *)(ring->data + pos);
+	record->size = need;
+	record->reserved = 0;
+
+	ring->pending = skip + need;
+	return record + 1;
+}
+
+static inline void audio_ring_commit(struct audio_ring *ring)
+{
+	audio_ring_store_release(&ring->cursors->head, ring->cursors->head + ring->pending);
+	ring->pending = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* consumer side                                                             */
+
+/* returns the next record's payload in place, or NULL if the ring is empty;
+ * the space is handed back to the producer on audio_ring_release */
+static inline void *audio_ring_peek(struct audio_ring *ring, uint32_t *size)
+{
+	uint32_t tail = ring->cursors->tail;
+	uint32_t head = audio_ring_load_acquire(&ring->cursors->head);
+	uint32_t pos = tail & (ring->capacity - 1);
+	uint32_t skip = 0;
+	struct audio_ring_record *record;
+
+	if (tail == head)
+		return NULL;
+
+	record = (struct audio_ring_record *)(ring->data + pos);
+	if (record->size == AUDIO_RING_WRAP_MARKER) {
+		/* the producer commits the marker together with the record
+		 * that follows it, so there is always one at offset 0 */
+		skip = ring->capacity - pos;
+		record = (struct audio_ring_record *)ring->data;
+	}
+
+	if (record->size < sizeof(*record) || record->size > head - tail - skip)
+		return NULL;
+
+	ring->pending = skip + record->size;
+	if (size)
+		*size = record->size - (uint32_t)sizeof(*record);
+	return record + 1;
+}
+
+static inline void audio_ring_release(struct audio_ring *ring)
+{
+	audio_ring_store_release(&ring->cursors->tail, ring->cursors->tail + ring->pending);
+	ring->pending = 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,89 @@
+#include <obs.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "channel-arena.h"
+
+#ifndef CHANNEL_ARENA_GUARD_PAGES
+#define CHANNEL_ARENA_GUARD_PAGES 0
+#endif
+
+#if CHANNEL_ARENA_GUARD_PAGES == 1
+#include <windows.h>
+#define GUARD_PAGE_SIZE 4096
+#endif
+
+static volatile long arena_allocations = 0;
+
+static inline size_t align_up(size_t size, size_t align)
+{
+	return (size + align - 1) & ~(align - 1);
+}
+
+size_t channel_arena_block_size(size_t size)
+{
+#if CHANNEL_ARENA_GUARD_PAGES == 1
+	return align_up(size, GUARD_PAGE_SIZE) + GUARD_PAGE_SIZE;
+#else
+	return align_up(size, CHANNEL_ARENA_ALIGN);
+#endif
+}
+
+bool channel_arena_init(struct channel_arena *arena, size_t capacity)
+{
+	memset(arena, 0, sizeof(*arena));
+
+#if CHANNEL_ARENA_GUARD_PAGES == 1
+	arena->mem = VirtualAlloc(NULL, capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	arena->base = arena->mem;
+#else
+	arena->mem = bmalloc(capacity + CHANNEL_ARENA_ALIGN - 1);
+	arena->base = (uint8_t *)align_up((size_t)arena->mem, CHANNEL_ARENA_ALIGN);
+#endif
+	if (!arena->mem)
+		return false;
+
+	arena->capacity = capacity;
+	os_atomic_inc_long(&arena_allocations);
+	return true;
+}
+
+void channel_arena_free(struct channel_arena *arena)
+{
+#if CHANNEL_ARENA_GUARD_PAGES == 1
+	if (arena->mem)
+		VirtualFree(arena->mem, 0, MEM_RELEASE);
+#else
+	bfree(arena->mem);
+#endif
+	memset(arena, 0, sizeof(*arena));
+}
+
+void *channel_arena_alloc(struct channel_arena *arena, size_t size)
+{
+	size_t block = channel_arena_block_size(size);
+	uint8_t *ptr;
+
+	if (block > arena->capacity - arena->used) {
+		blog(LOG_ERROR, "channel_arena_alloc: %zu bytes requested, %zu of %zu left", size, arena->capacity - arena->used,
+		     arena->capacity);
+		return NULL;
+	}
+
+	ptr = arena->base + arena->used;
+	arena->used += block;
+
+#if CHANNEL_ARENA_GUARD_PAGES == 1
+	DWORD old_protect;
+	VirtualProtect(arena->base + arena->used - GUARD_PAGE_SIZE, GUARD_PAGE_SIZE, PAGE_NOACCESS, &old_protect);
+
+	/* end the block right at the guard page, overruns are what matters */
+	ptr += align_up(size, GUARD_PAGE_SIZE) - align_up(size, CHANNEL_ARENA_ALIGN);
+#endif
+
+	return ptr;
+}
+
+long channel_arena_allocations(void)
+{
+	return os_atomic_load_long(&arena_allocations);
+}
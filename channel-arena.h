@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CHANNEL_ARENA_ALIGN 64
+
+/* one allocation that the planes of a channel, or the mixer's output
+ * planes, are carved from.  every block starts on a cache line so the simd
+ * kernels never split a line at the start of a plane, and the blocks sit
+ * next to each other.  with CHANNEL_ARENA_GUARD_PAGES every block is
+ * followed by an inaccessible page so overruns fault where they happen */
+struct channel_arena {
+	uint8_t *mem;
+	uint8_t *base;
+	size_t capacity;
+	size_t used;
+};
+
+/* space a block of size bytes takes in an arena, for sizing it up front */
+size_t channel_arena_block_size(size_t size);
+
+bool channel_arena_init(struct channel_arena *arena, size_t capacity);
+void channel_arena_free(struct channel_arena *arena);
+
+/* returns NULL once the arena is used up */
+void *channel_arena_alloc(struct channel_arena *arena, size_t size);
+
+/* heap allocations made by arenas so far; it only moves when channels are
+ * created, never while audio is flowing */
+long channel_arena_allocations(void);
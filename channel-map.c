@@ -0,0 +1,121 @@
+#include <util/bmem.h>
+#include "channel-map.h"
+
+#define CHANNEL_MAP_MIN_CAPACITY 16
+
+static inline size_t hash_key(uint64_t key, size_t capacity)
+{
+	/* the keys are heap pointers, so the low bits are mostly alignment */
+	key ^= key >> 33;
+	key *= 0xFF51AFD7ED558CCDULL;
+	key ^= key >> 33;
+	return (size_t)key & (capacity - 1);
+}
+
+void channel_map_init(struct channel_map *map)
+{
+	map->entries = NULL;
+	map->capacity = 0;
+	map->count = 0;
+	map->removed = 0;
+}
+
+void channel_map_free(struct channel_map *map)
+{
+	bfree(map->entries);
+	channel_map_init(map);
+}
+
+static struct channel_map_entry *find_entry(const struct channel_map *map, uint64_t key)
+{
+	size_t mask = map->capacity - 1;
+	size_t idx;
+
+	if (!map->capacity)
+		return NULL;
+
+	for (idx = hash_key(key, map->capacity);; idx = (idx + 1) & mask) {
+		struct channel_map_entry *entry = &map->entries[idx];
+
+		if (!entry->key)
+			return NULL;
+		if (entry->key == key && entry->channel)
+			return entry;
+	}
+}
+
+static void rehash(struct channel_map *map, size_t capacity)
+{
+	struct channel_map_entry *old = map->entries;
+	size_t old_capacity = map->capacity;
+
+	map->entries = bzalloc(capacity * sizeof(*map->entries));
+	map->capacity = capacity;
+	map->count = 0;
+	map->removed = 0;
+
+	for (size_t i = 0; i < old_capacity; i++) {
+		if (old[i].key && old[i].channel)
+			channel_map_insert(map, old[i].key, old[i].channel);
+	}
+
+	bfree(old);
+}
+
+struct audio_channel *channel_map_find(const struct channel_map *map, uint64_t key)
+{
+	struct channel_map_entry *entry = find_entry(map, key);
+	return entry ? entry->channel : NULL;
+}
+
+void channel_map_insert(struct channel_map *map, uint64_t key, struct audio_channel *channel)
+{
+	struct channel_map_entry *entry;
+	size_t mask;
+	size_t idx;
+
+	if (!key || !channel)
+		return;
+
+	entry = find_entry(map, key);
+	if (entry) {
+		entry->channel = channel;
+		return;
+	}
+
+	/* keep the load, removed slots included, under 3/4 so probes stay
+	 * short; only grow if the live entries need it */
+	if ((map->count + map->removed + 1) * 4 > map->capacity * 3) {
+		size_t capacity = map->capacity ? map->capacity : CHANNEL_MAP_MIN_CAPACITY;
+		while ((map->count + 1) * 2 > capacity)
+			capacity *= 2;
+		rehash(map, capacity);
+	}
+
+	mask = map->capacity - 1;
+	for (idx = hash_key(key, map->capacity);; idx = (idx + 1) & mask) {
+		entry = &map->entries[idx];
+		if (!entry->key || !entry->channel)
+			break;
+	}
+
+	if (entry->key)
+		map->removed--;
+
+	entry->key = key;
+	entry->channel = channel;
+	map->count++;
+}
+
+bool channel_map_remove(struct channel_map *map, uint64_t key)
+{
+	struct channel_map_entry *entry = find_entry(map, key);
+
+	if (!entry)
+		return false;
+
+	entry->channel = NULL;
+	map->count--;
+	map->removed++;
+	return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct audio_channel;
+
+/* open addressing hash from the hook's stream identity (the IAudioClient
+ * pointer in the target) to its audio_channel, linear probing.  key 0 marks
+ * an empty slot and a key without a channel a removed one.  not thread safe,
+ * it is owned by the capture thread */
+struct channel_map_entry {
+	uint64_t key;
+	struct audio_channel *channel;
+};
+
+struct channel_map {
+	struct channel_map_entry *entries;
+	size_t capacity;
+	size_t count;
+	size_t removed;
+};
+
+void channel_map_init(struct channel_map *map);
+void channel_map_free(struct channel_map *map);
+struct audio_channel *channel_map_find(const struct channel_map *map, uint64_t key);
+void channel_map_insert(struct channel_map *map, uint64_t key, struct audio_channel *channel);
+bool channel_map_remove(struct channel_map *map, uint64_t key);
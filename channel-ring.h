@@ -0,0 +1,177 @@
+#pragma once
+
+/* The planar sample ring of one channel and the timeline published with it.
+ *
+ * The capture thread is the only producer and the mix thread the only
+ * consumer, so it is lock free: the producer writes frames at its own
+ * write position and publishes them, together with the rest of the meta,
+ * under seq.  The consumer reads the frames in place and hands them back by
+ * advancing read_pos.  Like audio-ring.h this does not depend on libobs, the
+ * channel around it does. */
+
+#include "audio-ring.h"
+
+/* frames per plane, ~2.7 s at 48 kHz which covers the largest jitter delay
+ * plus the maximum mixer buffering */
+#define AUDIO_CHANNEL_RING_FRAMES (1 << 17)
+#define AUDIO_CHANNEL_RING_MASK (AUDIO_CHANNEL_RING_FRAMES - 1)
+
+#define CHANNEL_RING_MAX_PLANES 8
+
+/* the timeline of what the capture thread wrote: frames from seg_pos on
+ * start at seg_ts, and everything is delayed by delay.  segment changes on
+ * every discontinuity.  positions are free running frame counters */
+struct audio_channel_meta {
+	uint32_t write_pos;
+	uint32_t segment;
+	uint32_t seg_pos;
+	uint32_t reserved;
+	uint64_t seg_ts;
+	uint64_t delay;
+};
+
+/* the front of one plane of a channel, viewed in place as up to two
+ * contiguous runs because the underlying buffer wraps around */
+struct audio_span {
+	const float *data[2];
+	size_t frames[2];
+};
+
+struct channel_ring {
+	float *planes[CHANNEL_RING_MAX_PLANES];
+	size_t num_planes;
+
+	volatile uint32_t seq;
+	struct audio_channel_meta meta;
+	volatile uint32_t read_pos;
+
+	/* bumped by the consumer when it dropped everything, the producer
+	 * then has nothing left to append to */
+	volatile uint32_t resets;
+};
+
+static inline void channel_ring_reset(struct channel_ring *ring, const struct audio_channel_meta *meta)
+{
+	ring->seq = 0;
+	ring->meta = *meta;
+	ring->read_pos = 0;
+	ring->resets = 0;
+}
+
+/* the part of frames at pos that fits before the end of the buffer, the
+ * rest continues at its start */
+static inline size_t channel_ring_first_run(uint32_t pos, size_t frames)
+{
+	size_t first = AUDIO_CHANNEL_RING_FRAMES - (pos & AUDIO_CHANNEL_RING_MASK);
+	return first < frames ? first : frames;
+}
+
+/* ------------------------------------------------------------------------- */
+/* capture thread                                                            */
+
+/* frames written up to write_pos that the consumer did not hand back yet */
+static inline uint32_t channel_ring_fill(const struct channel_ring *ring, uint32_t write_pos)
+{
+	return write_pos - audio_ring_load_acquire(&ring->read_pos);
+}
+
+/* changes whenever the consumer dropped everything queued */
+static inline uint32_t channel_ring_resets(const struct channel_ring *ring)
+{
+	return audio_ring_load_acquire(&ring->resets);
+}
+
+/* frames that can be written at write_pos without overwriting any the
+ * consumer may still be reading */
+static inline size_t channel_ring_space(const struct channel_ring *ring, uint32_t write_pos)
+{
+	return AUDIO_CHANNEL_RING_FRAMES - (size_t)channel_ring_fill(ring, write_pos);
+}
+
+/* odd sequence while the copy is being rewritten, same as the stream table
+ * in shared memory.  frames up to meta->write_pos become visible with it */
+static inline void channel_ring_publish(struct channel_ring *ring, const struct audio_channel_meta *meta)
+{
+	uint32_t seq = ring->seq;
+
+	audio_ring_store_release(&ring->seq, seq + 1);
+	audio_ring_fence_release();
+
+	ring->meta = *meta;
+
+	audio_ring_store_release(&ring->seq, seq + 2);
+}
+
+/* ------------------------------------------------------------------------- */
+/* mix thread                                                                */
+
+/* bounded like the other sequence counter reads: a producer preempted
+ * mid-publish makes this fail, and the caller keeps the meta of the last
+ * tick rather than spinning until the capture thread runs again */
+static inline bool channel_ring_read_meta(const struct channel_ring *ring, struct audio_channel_meta *meta)
+{
+	struct audio_channel_meta copy;
+
+	for (int attempt = 0; attempt < 64; attempt++) {
+		uint32_t seq = audio_ring_load_acquire(&ring->seq);
+		if (seq & 1)
+			continue;
+
+		copy = ring->meta;
+
+		audio_ring_fence_acquire();
+		if (audio_ring_load_acquire(&ring->seq) == seq) {
+			*meta = copy;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* frames of plane ch from read_pos on, which stay valid until they are
+ * released; the producer never writes over frames before that */
+static inline void channel_ring_peek(const struct channel_ring *ring, size_t ch, size_t frames, struct audio_span *span)
+{
+	uint32_t pos = ring->read_pos;
+	size_t first = channel_ring_first_run(pos, frames);
+
+	span->data[0] = ring->planes[ch] + (pos & AUDIO_CHANNEL_RING_MASK);
+	span->frames[0] = first;
+	span->data[1] = ring->planes[ch];
+	span->frames[1] = frames - first;
+}
+
+/* before skip frames at read_pos are dropped, fades the fade frames after
+ * them in from the ones that would have played without the skip, in place,
+ * so the cut does not click on tonal content.  the consumer owns all of them
+ * until it releases them.  walks backwards because the two ranges overlap
+ * when skip < fade */
+static inline void channel_ring_crossfade(struct channel_ring *ring, size_t skip, size_t fade)
+{
+	uint32_t pos = ring->read_pos;
+
+	for (size_t ch = 0; ch < ring->num_planes; ch++) {
+		float *plane = ring->planes[ch];
+
+		for (size_t i = fade; i-- > 0;) {
+			float old = plane[(pos + (uint32_t)i) & AUDIO_CHANNEL_RING_MASK];
+			float *cur = plane + ((pos + (uint32_t)(skip + i)) & AUDIO_CHANNEL_RING_MASK);
+			float w = (float)(i + 1) / (float)(fade + 1);
+
+			*cur = old + (*cur - old) * w;
+		}
+	}
+}
+
+static inline void channel_ring_release(struct channel_ring *ring, uint32_t pos)
+{
+	audio_ring_store_release(&ring->read_pos, pos);
+}
+
+/* drops everything up to write_pos and tells the producer */
+static inline void channel_ring_clear(struct channel_ring *ring, uint32_t write_pos)
+{
+	channel_ring_release(ring, write_pos);
+	audio_ring_store_release(&ring->resets, ring->resets + 1);
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+/* cpuid probing shared by the plugin and the hook, no libobs or windows.h
+ * dependency so it can be included from either side */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define CPU_FEATURES_X86 1
+#else
+#define CPU_FEATURES_X86 0
+#endif
+
+#if CPU_FEATURES_X86 && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if CPU_FEATURES_X86
+static inline void cpu_run_cpuid(uint32_t eax, uint32_t ecx, uint32_t *abcd)
+{
+#if defined(_MSC_VER)
+	__cpuidex((int *)abcd, eax, ecx);
+#else
+	uint32_t ebx = 0, edx;
+#if defined(__i386__) && defined(__PIC__)
+	/* in case of PIC under 32-bit EBX cannot be clobbered */
+	__asm__("movl %%ebx, %%edi \n\t cpuid \n\t xchgl %%ebx, %%edi"
+		: "=D"(ebx),
+#else
+	__asm__("cpuid"
+		: "+b"(ebx),
+#endif
+		  "+a"(eax), "+c"(ecx), "=d"(edx));
+	abcd[0] = eax;
+	abcd[1] = ebx;
+	abcd[2] = ecx;
+	abcd[3] = edx;
+#endif
+}
+
+static inline bool cpu_check_xcr0_ymm(void)
+{
+	uint32_t xcr0;
+#if defined(_MSC_VER)
+	xcr0 = (uint32_t)_xgetbv(0); /* min VS2010 SP1 compiler is required */
+#else
+	__asm__("xgetbv" : "=a"(xcr0) : "c"(0) : "%edx");
+#endif
+	return (xcr0 & 6) == 6; /* checking if xmm and ymm state are enabled in XCR0 */
+}
+
+static inline bool cpu_has_sse2(void)
+{
+	uint32_t abcd[4];
+
+	/* CPUID.(EAX=01H, ECX=0H):EDX.SSE2[bit 26]==1 */
+	cpu_run_cpuid(1, 0, abcd);
+	return (abcd[3] & (1 << 26)) != 0;
+}
+
+static inline bool cpu_check_4th_gen_intel_core_features(void)
+{
+	uint32_t abcd[4];
+	uint32_t fma_movbe_osxsave_mask = ((1 << 12) | (1 << 22) | (1 << 27));
+	uint32_t avx2_bmi12_mask = (1 << 5) | (1 << 3) | (1 << 8);
+
+	/* CPUID.(EAX=01H, ECX=0H):ECX.FMA[bit 12]==1   &&
+		CPUID.(EAX=01H, ECX=0H):ECX.MOVBE[bit 22]==1 &&
+		CPUID.(EAX=01H, ECX=0H):ECX.OSXSAVE[bit 27]==1 */
+	cpu_run_cpuid(1, 0, abcd);
+	if ((abcd[2] & fma_movbe_osxsave_mask) != fma_movbe_osxsave_mask)
+		return false;
+
+	if (!cpu_check_xcr0_ymm())
+		return false;
+
+	/*  CPUID.(EAX=07H, ECX=0H):EBX.AVX2[bit 5]==1  &&
+		CPUID.(EAX=07H, ECX=0H):EBX.BMI1[bit 3]==1  &&
+		CPUID.(EAX=07H, ECX=0H):EBX.BMI2[bit 8]==1  */
+	cpu_run_cpuid(7, 0, abcd);
+	if ((abcd[1] & avx2_bmi12_mask) != avx2_bmi12_mask)
+		return false;
+
+	/* CPUID.(EAX=80000001H):ECX.LZCNT[bit 5]==1 */
+	cpu_run_cpuid(0x80000001, 0, abcd);
+	if ((abcd[2] & (1 << 5)) == 0)
+		return false;
+
+	return true;
+}
+#else
+static inline bool cpu_has_sse2(void)
+{
+	return false;
+}
+
+static inline bool cpu_check_4th_gen_intel_core_features(void)
+{
+	return false;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,111 @@
+#include <math.h>
+#include <string.h>
+#include "drift-comp.h"
+
+/* fill samples are taken per packet, so the mixer's tick shows up as a saw
+ * tooth of up to a tick; smoothing over a few seconds takes it out */
+#define DRIFT_FILL_SMOOTHING (1.0 / 512.0)
+
+/* the fill level right after a segment starts still has the startup
+ * transient in it */
+#define DRIFT_SETTLE_SECONDS 5
+
+/* ppm per frame of error and ppm per frame second, critically damped with
+ * a time constant of ~40 s at 48 kHz */
+#define DRIFT_KP 1.0
+#define DRIFT_KI 0.012
+
+/* real device clocks are within a few hundred ppm */
+#define DRIFT_MAX_PPM 1000.0
+
+static inline double clamp_ppm(double ppm)
+{
+	if (ppm > DRIFT_MAX_PPM)
+		return DRIFT_MAX_PPM;
+	if (ppm < -DRIFT_MAX_PPM)
+		return -DRIFT_MAX_PPM;
+	return ppm;
+}
+
+void drift_comp_init(struct drift_comp *dc)
+{
+	memset(dc, 0, sizeof(*dc));
+}
+
+void drift_comp_restart(struct drift_comp *dc)
+{
+	dc->primed = false;
+	dc->settled = false;
+	dc->settle_frames = 0;
+	dc->phase = 0.0;
+	dc->ppm = dc->integral;
+}
+
+void drift_comp_shift_target(struct drift_comp *dc, double frames)
+{
+	dc->target += frames;
+}
+
+void drift_comp_update(struct drift_comp *dc, uint32_t fill, size_t frames, size_t sample_rate)
+{
+	double err;
+
+	if (!dc->primed) {
+		dc->fill = (double)fill;
+		dc->primed = true;
+	} else {
+		dc->fill += ((double)fill - dc->fill) * DRIFT_FILL_SMOOTHING;
+	}
+
+	if (!dc->settled) {
+		dc->settle_frames += frames;
+		if (dc->settle_frames >= (uint64_t)sample_rate * DRIFT_SETTLE_SECONDS) {
+			dc->target = dc->fill;
+			dc->settled = true;
+		}
+		return;
+	}
+
+	/* too full means the target's clock runs fast, so more input is
+	 * consumed per output frame */
+	err = dc->fill - dc->target;
+	dc->integral = clamp_ppm(dc->integral + DRIFT_KI * err * (double)frames / (double)sample_rate);
+	dc->ppm = clamp_ppm(DRIFT_KP * err + dc->integral);
+}
+
+/* output frame n is taken at input position phase + n * step, where -1 is
+ * the last frame of the previous packet */
+size_t drift_comp_process(struct drift_comp *dc, float *const *dst, const float *const *src, size_t planes, size_t frames)
+{
+	double step = 1.0 + dc->ppm * 0.000001;
+	double end = (double)frames - 1.0;
+	double pos = dc->phase;
+	size_t out = 0;
+
+	if (!frames)
+		return 0;
+
+	for (size_t p = 0; p < planes; p++) {
+		const float *in = src[p];
+		float *o = dst[p];
+
+		pos = dc->phase;
+		out = 0;
+
+		while (pos < end) {
+			double base = floor(pos);
+			long i = (long)base;
+			float frac = (float)(pos - base);
+			float a = i < 0 ? dc->last[p] : in[i];
+			float b = in[i + 1];
+
+			o[out++] = a + (b - a) * frac;
+			pos += step;
+		}
+
+		dc->last[p] = in[frames - 1];
+	}
+
+	dc->phase = pos - (double)frames;
+	return out;
+}
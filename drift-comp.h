@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DRIFT_COMP_MAX_PLANES 8
+
+/* keeps a channel's ring as full as it was once the stream settled by
+ * resampling it at a slightly different rate.  a PI controller on the
+ * smoothed fill level gives the correction in ppm, whose integral part is
+ * the drift between the target's device clock and the obs clock; a linear
+ * interpolator applies it to the planar samples */
+struct drift_comp {
+	bool primed;
+	bool settled;
+	uint64_t settle_frames;
+	double fill;
+	double target;
+	double integral;
+	double ppm;
+
+	double phase;
+	float last[DRIFT_COMP_MAX_PLANES];
+};
+
+void drift_comp_init(struct drift_comp *dc);
+
+/* the stream started a new segment, the fill level is measured again but
+ * the drift estimate is kept */
+void drift_comp_restart(struct drift_comp *dc);
+
+/* the fill level is expected to change by frames, e.g. with the delay */
+void drift_comp_shift_target(struct drift_comp *dc, double frames);
+
+void drift_comp_update(struct drift_comp *dc, uint32_t fill, size_t frames, size_t sample_rate);
+
+static inline bool drift_comp_active(const struct drift_comp *dc)
+{
+	return dc->ppm != 0.0 || dc->phase != 0.0;
+}
+
+static inline size_t drift_comp_max_output(size_t frames)
+{
+	return frames + frames / 512 + 2;
+}
+
+/* returns the number of frames written to dst, at most
+ * drift_comp_max_output(frames) */
+size_t drift_comp_process(struct drift_comp *dc, float *const *dst, const float *const *src, size_t planes, size_t frames);
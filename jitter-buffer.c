@@ -0,0 +1,91 @@
+#include <string.h>
+#include "jitter-buffer.h"
+
+/* halve the histogram once this many samples were seen, roughly 20 seconds
+ * at typical WASAPI periods */
+#define JITTER_DECAY_TOTAL 2000
+
+/* recompute the delay every this many samples */
+#define JITTER_UPDATE_INTERVAL 16
+
+/* shrink by at most this much per update, growing is immediate */
+#define JITTER_MAX_SHRINK_STEP 1000000ULL
+
+static inline uint64_t clamp_delay(const struct jitter_params *params, uint64_t delay)
+{
+	if (delay < params->min_delay)
+		delay = params->min_delay;
+	if (delay > params->max_delay)
+		delay = params->max_delay;
+	return delay;
+}
+
+void jitter_buffer_init(struct jitter_buffer *jb, const struct jitter_params *params)
+{
+	memset(jb, 0, sizeof(*jb));
+	jb->params = *params;
+
+	/* start at the upper bound until there is something to go by */
+	jb->delay = params->max_delay;
+}
+
+void jitter_buffer_set_params(struct jitter_buffer *jb, const struct jitter_params *params)
+{
+	jb->params = *params;
+	jb->delay = clamp_delay(params, jb->delay);
+}
+
+static uint64_t percentile_lateness(const struct jitter_buffer *jb)
+{
+	uint64_t wanted = ((uint64_t)jb->total * jb->params.percentile + 99) / 100;
+	uint64_t count = 0;
+
+	for (size_t i = 0; i < JITTER_BUCKETS; i++) {
+		count += jb->histogram[i];
+		if (count >= wanted)
+			return (uint64_t)(i + 1) * JITTER_BUCKET_NS;
+	}
+
+	return JITTER_BUCKETS * JITTER_BUCKET_NS;
+}
+
+bool jitter_buffer_add_sample(struct jitter_buffer *jb, uint64_t lateness)
+{
+	uint64_t bucket = lateness / JITTER_BUCKET_NS;
+	uint64_t target;
+	uint64_t delay;
+
+	if (bucket >= JITTER_BUCKETS)
+		bucket = JITTER_BUCKETS - 1;
+
+	jb->histogram[bucket]++;
+	jb->total++;
+
+	if (jb->total >= JITTER_DECAY_TOTAL) {
+		jb->total = 0;
+		for (size_t i = 0; i < JITTER_BUCKETS; i++) {
+			jb->histogram[i] /= 2;
+			jb->total += jb->histogram[i];
+		}
+	}
+
+	if (++jb->since_update < JITTER_UPDATE_INTERVAL)
+		return false;
+	jb->since_update = 0;
+
+	target = clamp_delay(&jb->params, percentile_lateness(jb) + jb->params.margin);
+	delay = jb->delay;
+
+	if (target > delay)
+		delay = target;
+	else if (delay - target > JITTER_MAX_SHRINK_STEP)
+		delay -= JITTER_MAX_SHRINK_STEP;
+	else
+		delay = target;
+
+	if (delay == jb->delay)
+		return false;
+
+	jb->delay = delay;
+	return true;
+}
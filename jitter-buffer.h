@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* 1 ms buckets, anything later than the last one is counted in it */
+#define JITTER_BUCKETS 500
+#define JITTER_BUCKET_NS 1000000ULL
+
+struct jitter_params {
+	uint64_t min_delay;
+	uint64_t max_delay;
+	uint64_t margin;
+	uint32_t percentile;
+};
+
+/* tracks how late packets arrive relative to the timestamp the mixer needs
+ * them by, and derives the delay that covers `percentile` percent of them.
+ * older observations decay so the delay follows the current conditions. */
+struct jitter_buffer {
+	struct jitter_params params;
+	uint32_t histogram[JITTER_BUCKETS];
+	uint32_t total;
+	uint32_t since_update;
+	uint64_t delay;
+};
+
+void jitter_buffer_init(struct jitter_buffer *jb, const struct jitter_params *params);
+void jitter_buffer_set_params(struct jitter_buffer *jb, const struct jitter_params *params);
+
+/* lateness is arrival time minus the time the last sample of the packet is
+ * due, 0 if it arrived early; returns true if the wanted delay changed */
+bool jitter_buffer_add_sample(struct jitter_buffer *jb, uint64_t lateness);
+
+static inline uint64_t jitter_buffer_delay(const struct jitter_buffer *jb)
+{
+	return jb->delay;
+}
@@ -0,0 +1,95 @@
+#include "mix-scheduler.h"
+#include <string.h>
+
+/* lateness below this is just wakeup latency and not counted */
+#define LATE_THRESHOLD_NS 1000000ULL
+
+/* split so the product can not overflow however long the source runs */
+static inline uint64_t frames_to_ns(size_t sample_rate, uint64_t frames)
+{
+	return frames / sample_rate * 1000000000ULL + frames % sample_rate * 1000000000ULL / sample_rate;
+}
+
+void mix_scheduler_init(struct mix_scheduler *sched, const struct mix_clock *clock, size_t sample_rate, size_t frames_per_tick)
+{
+	memset(sched, 0, sizeof(*sched));
+	sched->clock = *clock;
+	sched->sample_rate = sample_rate;
+	sched->frames_per_tick = frames_per_tick;
+	sched->start_time = clock->now(clock->param);
+	sched->deadline = sched->start_time;
+}
+
+static inline uint64_t tick_time(const struct mix_scheduler *sched, uint64_t samples)
+{
+	return sched->start_time + frames_to_ns(sched->sample_rate, samples);
+}
+
+size_t mix_scheduler_wait(struct mix_scheduler *sched)
+{
+	struct mix_scheduler_stats *stats = &sched->stats;
+	uint64_t now = sched->clock.now(sched->clock.param);
+	uint64_t samples = sched->samples;
+	size_t due = 0;
+
+	if (now < sched->deadline) {
+		sched->clock.sleep_until(sched->clock.param, sched->deadline);
+		now = sched->clock.now(sched->clock.param);
+	}
+
+	/* a tick is due once the previous one's timestamp has passed */
+	while (tick_time(sched, samples) <= now) {
+		samples += sched->frames_per_tick;
+		due++;
+	}
+
+	if (!due) {
+		/* woke up early, run the tick anyway rather than spin */
+		due = 1;
+	} else if (now - sched->deadline > LATE_THRESHOLD_NS) {
+		uint64_t lateness = now - sched->deadline;
+
+		stats->late_ticks++;
+		if (lateness > stats->max_lateness)
+			stats->max_lateness = lateness;
+	}
+
+	if (due > 1) {
+		stats->bursts++;
+		stats->catch_up_ticks += due - 1;
+		if (due > stats->max_burst)
+			stats->max_burst = due;
+	}
+
+	stats->ticks += due;
+	return due;
+}
+
+size_t mix_scheduler_wait_ready(struct mix_scheduler *sched, mix_ready_cb ready, void *param)
+{
+	uint64_t tick_ns = frames_to_ns(sched->sample_rate, sched->frames_per_tick);
+	uint64_t earliest = sched->start_time;
+	uint64_t now = sched->clock.now(sched->clock.param);
+
+	if (now >= sched->deadline)
+		return mix_scheduler_wait(sched);
+
+	if (sched->deadline - sched->start_time > tick_ns)
+		earliest = sched->deadline - tick_ns;
+	if (now < earliest)
+		sched->clock.sleep_until(sched->clock.param, earliest);
+
+	if (!ready(param, sched->deadline) || sched->clock.now(sched->clock.param) >= sched->deadline)
+		return mix_scheduler_wait(sched);
+
+	sched->stats.early_ticks++;
+	sched->stats.ticks++;
+	return 1;
+}
+
+uint64_t mix_scheduler_advance(struct mix_scheduler *sched)
+{
+	sched->samples += sched->frames_per_tick;
+	sched->deadline = tick_time(sched, sched->samples);
+	return sched->deadline;
+}
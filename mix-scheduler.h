@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* time source of the scheduler.  now returns nanoseconds on a monotonic
+ * clock and sleep_until blocks until now would return at least the given
+ * absolute time.  the scheduler itself has no libobs dependency, the plugin
+ * passes in os_gettime_ns and os_sleepto_ns */
+struct mix_clock {
+	uint64_t (*now)(void *param);
+	void (*sleep_until)(void *param, uint64_t deadline);
+	void *param;
+};
+
+struct mix_scheduler_stats {
+	uint64_t ticks;
+	/* ticks run more than a millisecond after their deadline, and how late
+	 * the worst of them was */
+	uint64_t late_ticks;
+	uint64_t max_lateness;
+	/* wakeups that had to run more than one tick to catch up, the ticks run
+	 * that way and the largest such burst */
+	uint64_t bursts;
+	uint64_t catch_up_ticks;
+	uint64_t max_burst;
+	/* ticks run ahead of their deadline because the input was ready */
+	uint64_t early_ticks;
+};
+
+/* paces the mix thread at one tick per frames_per_tick frames.  every tick
+ * has an absolute deadline derived from the start time and the number of
+ * frames mixed so far, so rounding in the sleeps never accumulates */
+struct mix_scheduler {
+	struct mix_clock clock;
+	size_t sample_rate;
+	size_t frames_per_tick;
+
+	uint64_t start_time;
+	uint64_t samples;
+	uint64_t deadline;
+
+	struct mix_scheduler_stats stats;
+};
+
+void mix_scheduler_init(struct mix_scheduler *sched, const struct mix_clock *clock, size_t sample_rate, size_t frames_per_tick);
+
+/* sleeps until the next deadline and returns how many ticks are due, at
+ * least one */
+size_t mix_scheduler_wait(struct mix_scheduler *sched);
+
+/* blocks until the input for the next tick is ready or the deadline passes,
+ * returning true if it is ready */
+typedef bool (*mix_ready_cb)(void *param, uint64_t deadline);
+
+/* like mix_scheduler_wait, but runs the next tick as soon as ready reports
+ * the input for it, at most one tick ahead of its deadline; the timer only
+ * drives the ticks while some input is stalled */
+size_t mix_scheduler_wait_ready(struct mix_scheduler *sched, mix_ready_cb ready, void *param);
+
+/* advances by one tick and returns the timestamp the tick mixes up to */
+uint64_t mix_scheduler_advance(struct mix_scheduler *sched);
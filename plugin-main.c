@@ -6,6 +6,7 @@
 #include <util/pipe.h>
 #include <util/config-file.h>
 #include "wasapi-hook-info.h"
+#include "audio-kernels.h"
 
 OBS_DECLARE_MODULE()
 OBS_MODULE_USE_DEFAULT_LOCALE("wasapi-capture", "en-US")
@@ -125,6 +126,9 @@ void wait_for_hook_initialization(void)
 
 bool obs_module_load(void)
 {
+	enum audio_kernel_level level = audio_kernels_init();
+	blog(LOG_INFO, "wasapi-capture: using %s mix kernels", audio_kernel_level_name(level));
+
 	init_hooks_thread = CreateThread(NULL, 0, init_hooks, NULL, 0, NULL);
 	obs_register_source(&wasapi_capture_info);
 	return true;
@@ -0,0 +1,100 @@
+#include <obs.h>
+#include "resampler-pool.h"
+
+/* a handful of formats covers every stream a process opens */
+#define RESAMPLER_POOL_SIZE 16
+
+/* silence run through a returned resampler, far longer than the filter
+ * history of the libobs (swresample) resampler */
+#define RESAMPLER_FLUSH_MS 20
+
+static inline bool info_equal(const struct resample_info *a, const struct resample_info *b)
+{
+	return a->samples_per_sec == b->samples_per_sec && a->format == b->format && a->speakers == b->speakers;
+}
+
+void resampler_pool_init(struct resampler_pool *pool)
+{
+	da_init(pool->idle);
+	da_init(pool->silence);
+	pool->created = 0;
+}
+
+void resampler_pool_free(struct resampler_pool *pool)
+{
+	for (size_t i = 0; i < pool->idle.num; i++)
+		audio_resampler_destroy(pool->idle.array[i].resampler);
+	da_free(pool->idle);
+	da_free(pool->silence);
+}
+
+/* the most recently returned resamplers are at the end */
+audio_resampler_t *resampler_pool_get(struct resampler_pool *pool, const struct resample_info *dst, const struct resample_info *src)
+{
+	audio_resampler_t *resampler;
+
+	for (size_t i = pool->idle.num; i > 0; i--) {
+		struct resampler_pool_entry *entry = &pool->idle.array[i - 1];
+
+		if (info_equal(&entry->dst, dst) && info_equal(&entry->src, src)) {
+			resampler = entry->resampler;
+			da_erase(pool->idle, i - 1);
+			return resampler;
+		}
+	}
+
+	resampler = audio_resampler_create(dst, src);
+	if (resampler) {
+		pool->created++;
+		blog(LOG_DEBUG, "created resampler %u Hz/%d/%d -> %u Hz/%d/%d (%zu total)", src->samples_per_sec, (int)src->format,
+		     (int)src->speakers, dst->samples_per_sec, (int)dst->format, (int)dst->speakers, pool->created);
+	}
+	return resampler;
+}
+
+/* libobs has no way to reset a resampler, so the history of the stream it
+ * served last, and any output it still buffers, is pushed out with silence
+ * and thrown away; the next stream then starts as it would on a new one */
+static void flush_resampler(struct resampler_pool *pool, const struct resample_info *src, audio_resampler_t *resampler)
+{
+	uint32_t frames = src->samples_per_sec * RESAMPLER_FLUSH_MS / 1000;
+	size_t channels = get_audio_channels(src->speakers);
+	size_t plane_size = frames * get_audio_bytes_per_channel(src->format) * (is_audio_planar(src->format) ? 1 : channels);
+	size_t planes = is_audio_planar(src->format) ? channels : 1;
+	bool u8 = src->format == AUDIO_FORMAT_U8BIT || src->format == AUDIO_FORMAT_U8BIT_PLANAR;
+	const uint8_t *input[MAX_AV_PLANES] = {0};
+	uint8_t *output[MAX_AV_PLANES];
+	uint32_t out_frames;
+	uint64_t ts_offset;
+
+	if (!frames || !plane_size || planes > MAX_AV_PLANES)
+		return;
+
+	da_resize(pool->silence, plane_size);
+	memset(pool->silence.array, u8 ? 0x80 : 0, plane_size);
+	for (size_t i = 0; i < planes; i++)
+		input[i] = pool->silence.array;
+
+	audio_resampler_resample(resampler, output, &out_frames, &ts_offset, input, frames);
+}
+
+void resampler_pool_put(struct resampler_pool *pool, const struct resample_info *dst, const struct resample_info *src,
+			audio_resampler_t *resampler)
+{
+	struct resampler_pool_entry entry;
+
+	if (!resampler)
+		return;
+
+	flush_resampler(pool, src, resampler);
+
+	if (pool->idle.num == RESAMPLER_POOL_SIZE) {
+		audio_resampler_destroy(pool->idle.array[0].resampler);
+		da_erase(pool->idle, 0);
+	}
+
+	entry.dst = *dst;
+	entry.src = *src;
+	entry.resampler = resampler;
+	da_push_back(pool->idle, &entry);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <media-io/audio-resampler.h>
+#include <util/darray.h>
+
+/* idle resamplers kept per (input, output) format, so a stream that flips
+ * back to a format it had before, or a new stream in a known format, gets
+ * one without constructing it.  not thread safe, it is owned by the capture
+ * thread */
+struct resampler_pool_entry {
+	struct resample_info dst;
+	struct resample_info src;
+	audio_resampler_t *resampler;
+};
+
+struct resampler_pool {
+	DARRAY(struct resampler_pool_entry) idle;
+	size_t created;
+
+	/* silence in the input format, used to flush returned resamplers */
+	DARRAY(uint8_t) silence;
+};
+
+void resampler_pool_init(struct resampler_pool *pool);
+void resampler_pool_free(struct resampler_pool *pool);
+
+audio_resampler_t *resampler_pool_get(struct resampler_pool *pool, const struct resample_info *dst, const struct resample_info *src);
+void resampler_pool_put(struct resampler_pool *pool, const struct resample_info *dst, const struct resample_info *src,
+			audio_resampler_t *resampler);
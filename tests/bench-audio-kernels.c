@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "audio-kernels.h"
+#include "bench-helpers.h"
+
+/* one mix tick of a browser like target: many streams, stereo, 1024
+ * frames, the output block size of obs */
+#define BENCH_FRAMES 1024
+#define BENCH_SOURCES 32
+
+static int iterations = 2000;
+
+static float *alloc_plane(void)
+{
+	float *plane = malloc(BENCH_FRAMES * sizeof(float));
+	for (size_t i = 0; i < BENCH_FRAMES; i++)
+		plane[i] = (float)((i * 7919) % 2000) / 1000.0f - 1.0f;
+	return plane;
+}
+
+/* the fused kernel against the accumulate-then-clamp loop it replaced */
+static void bench_mix(const char *level)
+{
+	float *src[BENCH_SOURCES];
+	float *dst = alloc_plane();
+
+	for (size_t s = 0; s < BENCH_SOURCES; s++)
+		src[s] = alloc_plane();
+
+	uint64_t start = bench_now_ns();
+	for (int it = 0; it < iterations; it++) {
+		for (size_t i = 0; i < BENCH_FRAMES; i++)
+			dst[i] = 0.0f;
+		for (size_t s = 0; s < BENCH_SOURCES; s++)
+			audio_mix_float(dst, src[s], BENCH_FRAMES);
+		for (size_t i = 0; i < BENCH_FRAMES; i++)
+			dst[i] = dst[i] > 1.0f ? 1.0f : dst[i] < -1.0f ? -1.0f : dst[i];
+	}
+	uint64_t accumulate = bench_now_ns() - start;
+	bench_sink = dst[BENCH_FRAMES / 2];
+
+	start = bench_now_ns();
+	for (int it = 0; it < iterations; it++)
+		audio_mix_fused(dst, (const float *const *)src, BENCH_SOURCES, BENCH_FRAMES);
+	uint64_t fused = bench_now_ns() - start;
+	bench_sink = dst[BENCH_FRAMES / 2];
+
+	printf("%-8s mix %d streams:     accumulate %8.1f ns/tick, fused %8.1f ns/tick\n", level, BENCH_SOURCES,
+	       (double)accumulate / iterations, (double)fused / iterations);
+
+	for (size_t s = 0; s < BENCH_SOURCES; s++)
+		free(src[s]);
+	free(dst);
+}
+
+/* the typed kernels the hook's proxy mixes its streams with, one stereo
+ * stream into another */
+#define BENCH_MIX_INT(name, type)                                                                \
+	static double bench_mix_##name(void)                                                    \
+	{                                                                                        \
+		type *dst = malloc(BENCH_FRAMES * 2 * sizeof(type));                            \
+		type *src = malloc(BENCH_FRAMES * 2 * sizeof(type));                            \
+                                                                                                 \
+		for (size_t i = 0; i < BENCH_FRAMES * 2; i++) {                                 \
+			dst[i] = (type)(i * 7919);                                               \
+			src[i] = (type)(i * 104729);                                             \
+		}                                                                                \
+                                                                                                 \
+		uint64_t start = bench_now_ns();                                                 \
+		for (int it = 0; it < iterations * 8; it++)                                      \
+			audio_mix_##name(dst, src, BENCH_FRAMES * 2);                            \
+		uint64_t elapsed = bench_now_ns() - start;                                       \
+		bench_sink = (float)dst[BENCH_FRAMES];                                           \
+                                                                                                 \
+		free(src);                                                                       \
+		free(dst);                                                                       \
+		return (double)elapsed / (iterations * 8);                                       \
+	}
+
+BENCH_MIX_INT(s16, int16_t)
+BENCH_MIX_INT(s32, int32_t)
+
+static void bench_mix_int(const char *level)
+{
+	printf("%-8s mix stereo:          s16 %8.1f ns/tick, s32 %8.1f ns/tick\n", level, bench_mix_s16(), bench_mix_s32());
+}
+
+/* the convert-only path for a stereo packet of one tick, against the
+ * scalar level as the baseline */
+#define BENCH_DEINTERLEAVE(name, type, scale)                                                                                  \
+	static double bench_deinterleave_##name(void)                                                                         \
+	{                                                                                                                      \
+		type *src = malloc(BENCH_FRAMES * 2 * sizeof(type));                                                          \
+		float *left = alloc_plane(), *right = alloc_plane();                                                          \
+		float *dst[2] = {left, right};                                                                                 \
+                                                                                                                               \
+		for (size_t i = 0; i < BENCH_FRAMES * 2; i++)                                                                   \
+			src[i] = (type)(((double)((i * 7919) % 2000) / 1000.0 - 1.0) * (scale));                             \
+                                                                                                                               \
+		uint64_t start = bench_now_ns();                                                                               \
+		for (int it = 0; it < iterations * 8; it++)                                                                    \
+			audio_deinterleave_##name(dst, src, 2, BENCH_FRAMES);                                                  \
+		uint64_t elapsed = bench_now_ns() - start;                                                                     \
+		bench_sink = left[BENCH_FRAMES / 2] + right[BENCH_FRAMES / 2];                                                 \
+                                                                                                                               \
+		free(src);                                                                                                     \
+		free(left);                                                                                                    \
+		free(right);                                                                                                   \
+		return (double)elapsed / (iterations * 8);                                                                    \
+	}
+
+BENCH_DEINTERLEAVE(float, float, 1.0)
+BENCH_DEINTERLEAVE(s16, int16_t, 32767.0)
+BENCH_DEINTERLEAVE(s32, int32_t, 2147483647.0)
+
+static void bench_deinterleave(const char *level)
+{
+	printf("%-8s deinterleave stereo: float %8.1f ns/tick, s16 %8.1f ns/tick, s32 %8.1f ns/tick\n", level,
+	       bench_deinterleave_float(), bench_deinterleave_s16(), bench_deinterleave_s32());
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+
+	for (int level = AUDIO_KERNEL_SCALAR; level <= AUDIO_KERNEL_AVX2; level++) {
+		enum audio_kernel_level selected = audio_kernels_select((enum audio_kernel_level)level);
+		if ((int)selected != level)
+			break;
+
+		bench_mix(audio_kernel_level_name(selected));
+		bench_mix_int(audio_kernel_level_name(selected));
+		bench_deinterleave(audio_kernel_level_name(selected));
+	}
+
+	return 0;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+/* timing for the standalone benchmarks */
+
+#include <stdint.h>
+#include <time.h>
+
+static inline uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* defeats dead store elimination of the benchmarked output */
+static volatile float bench_sink;
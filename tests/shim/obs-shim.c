@@ -0,0 +1,25 @@
+#include "obs.h"
+
+long shim_heap_allocations = 0;
+
+void *bmalloc(size_t size)
+{
+	shim_heap_allocations++;
+	return malloc(size ? size : 1);
+}
+
+void bfree(void *ptr)
+{
+	free(ptr);
+}
+
+void blog(int log_level, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	fprintf(stderr, "[%d] ", log_level);
+	vfprintf(stderr, format, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+}
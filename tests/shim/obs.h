@@ -0,0 +1,24 @@
+#pragma once
+
+/* the handful of libobs calls the tested modules make, so they build in the
+ * standalone tests.  heap allocations are counted for the tests to check */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+	LOG_ERROR = 100,
+	LOG_WARNING = 200,
+	LOG_INFO = 300,
+	LOG_DEBUG = 400,
+};
+
+extern long shim_heap_allocations;
+
+void *bmalloc(size_t size);
+void bfree(void *ptr);
+void blog(int log_level, const char *format, ...);
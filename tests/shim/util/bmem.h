@@ -0,0 +1,11 @@
+#pragma once
+
+#include "../obs.h"
+
+static inline void *bzalloc(size_t size)
+{
+	void *mem = bmalloc(size);
+	if (mem)
+		memset(mem, 0, size);
+	return mem;
+}
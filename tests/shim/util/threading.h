@@ -0,0 +1,11 @@
+#pragma once
+
+static inline long os_atomic_inc_long(volatile long *val)
+{
+	return __atomic_add_fetch(val, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline long os_atomic_load_long(const volatile long *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
@@ -0,0 +1,170 @@
+#include <math.h>
+#include <string.h>
+#include "audio-kernels.h"
+#include "test-helpers.h"
+
+/* covers the unrolled simd blocks, the scalar tails and unaligned starts */
+#define MAX_COUNT 301
+#define MAX_SOURCES 5
+#define MAX_CHANNELS 8
+
+static uint32_t rand_state = 1;
+
+static inline uint32_t next_rand(void)
+{
+	rand_state = rand_state * 1664525u + 1013904223u;
+	return rand_state >> 8;
+}
+
+static inline float rand_float(float range)
+{
+	return ((float)(next_rand() & 0xFFFF) / 32768.0f - 1.0f) * range;
+}
+
+/* the reference versions are written independently of the kernels' own
+ * scalar fallbacks, so those are checked as well */
+
+static void check_mix_float(void)
+{
+	float dst[MAX_COUNT + 1], src[MAX_COUNT + 1], ref[MAX_COUNT + 1];
+
+	for (size_t count = 0; count < MAX_COUNT; count++) {
+		for (size_t off = 0; off < 2; off++) {
+			for (size_t i = 0; i < MAX_COUNT + 1; i++) {
+				dst[i] = rand_float(1.0f);
+				src[i] = rand_float(1.0f);
+				ref[i] = dst[i];
+			}
+			for (size_t i = 0; i < count; i++)
+				ref[i + off] = dst[i + off] + src[i + off];
+
+			audio_mix_float(dst + off, src + off, count);
+			CHECK(memcmp(dst, ref, sizeof(dst)) == 0);
+		}
+	}
+}
+
+/* every other sample is pushed to the limits of the type, so both the
+ * plain adds and the saturating ones in either direction are covered */
+#define CHECK_MIX_INT(name, type, wide, lo, hi)                                                            \
+	static type rand_##name(void)                                                                      \
+	{                                                                                                   \
+		uint32_t r = next_rand();                                                                  \
+		if (r & 1)                                                                                  \
+			return (r & 2) ? (hi) - (type)(next_rand() & 0xFF) : (lo) + (type)(next_rand() & 0xFF); \
+		return (type)((next_rand() << 8) ^ next_rand());                                           \
+	}                                                                                                   \
+                                                                                                            \
+	static void check_mix_##name(void)                                                                 \
+	{                                                                                                   \
+		type dst[MAX_COUNT + 1], src[MAX_COUNT + 1], ref[MAX_COUNT + 1];                           \
+                                                                                                            \
+		for (size_t count = 0; count < MAX_COUNT; count++) {                                       \
+			for (size_t off = 0; off < 2; off++) {                                             \
+				for (size_t i = 0; i < MAX_COUNT + 1; i++) {                               \
+					dst[i] = rand_##name();                                             \
+					src[i] = rand_##name();                                             \
+					ref[i] = dst[i];                                                    \
+				}                                                                           \
+				for (size_t i = 0; i < count; i++) {                                       \
+					wide val = (wide)dst[i + off] + (wide)src[i + off];                 \
+					ref[i + off] = (type)(val < (lo) ? (lo) : val > (hi) ? (hi) : val); \
+				}                                                                           \
+                                                                                                            \
+				audio_mix_##name(dst + off, src + off, count);                              \
+				CHECK(memcmp(dst, ref, sizeof(dst)) == 0);                                  \
+			}                                                                                   \
+		}                                                                                           \
+	}
+
+CHECK_MIX_INT(s16, int16_t, int32_t, INT16_MIN, INT16_MAX)
+CHECK_MIX_INT(s32, int32_t, int64_t, INT32_MIN, INT32_MAX)
+
+static void check_mix_fused(void)
+{
+	static float src_data[MAX_SOURCES][MAX_COUNT + 1];
+	const float *src[MAX_SOURCES];
+	float dst[MAX_COUNT + 1], ref[MAX_COUNT + 1];
+
+	for (size_t num_src = 0; num_src <= MAX_SOURCES; num_src++) {
+		for (size_t count = 0; count < MAX_COUNT; count += 7) {
+			for (size_t s = 0; s < MAX_SOURCES; s++) {
+				for (size_t i = 0; i < MAX_COUNT + 1; i++)
+					src_data[s][i] = rand_float(0.4f);
+				src[s] = src_data[s] + (s & 1);
+			}
+
+			for (size_t i = 0; i < MAX_COUNT + 1; i++)
+				dst[i] = ref[i] = 42.0f;
+			for (size_t i = 0; i < count; i++) {
+				float val = 0.0f;
+				for (size_t s = 0; s < num_src; s++)
+					val += src[s][i];
+				ref[i] = fminf(fmaxf(val, -1.0f), 1.0f);
+			}
+
+			audio_mix_fused(dst, src, num_src, count);
+			for (size_t i = 0; i < MAX_COUNT + 1; i++)
+				CHECK(fabsf(dst[i] - ref[i]) <= 1e-6f);
+		}
+	}
+}
+
+/* mono and stereo have simd versions, the rest fall back to the scalar loop
+ * at every level; integer samples scale to [-1, 1) */
+#define CHECK_DEINTERLEAVE(name, type, gen, scale)                                                     \
+	static void check_deinterleave_##name(void)                                                   \
+	{                                                                                               \
+		static type src[MAX_CHANNELS * MAX_COUNT + 1];                                        \
+		static float planes[MAX_CHANNELS][MAX_COUNT + 1];                                      \
+		float *dst[MAX_CHANNELS];                                                               \
+                                                                                                        \
+		for (size_t c = 0; c < MAX_CHANNELS; c++)                                              \
+			dst[c] = planes[c];                                                             \
+                                                                                                        \
+		for (size_t channels = 1; channels <= MAX_CHANNELS; channels++) {                      \
+			for (size_t frames = 0; frames < MAX_COUNT; frames += 5) {                      \
+				for (size_t i = 0; i < MAX_CHANNELS * MAX_COUNT + 1; i++)              \
+					src[i] = (type)(gen);                                           \
+				for (size_t c = 0; c < MAX_CHANNELS; c++)                              \
+					for (size_t i = 0; i < MAX_COUNT + 1; i++)                      \
+						planes[c][i] = 42.0f;                                   \
+                                                                                                        \
+				/* odd source offset, so the loads are unaligned */                     \
+				audio_deinterleave_##name(dst, src + 1, channels, frames);              \
+                                                                                                        \
+				for (size_t c = 0; c < MAX_CHANNELS; c++) {                            \
+					for (size_t i = 0; i < MAX_COUNT + 1; i++) {                    \
+						float ref = 42.0f;                                      \
+						if (c < channels && i < frames)                         \
+							ref = (float)src[1 + i * channels + c] * (scale); \
+						CHECK(planes[c][i] == ref);                             \
+					}                                                               \
+				}                                                                       \
+			}                                                                               \
+		}                                                                                       \
+	}
+
+CHECK_DEINTERLEAVE(float, float, rand_float(1.0f), 1.0f)
+CHECK_DEINTERLEAVE(s16, int16_t, next_rand() & 0xFFFF, 1.0f / 32768.0f)
+CHECK_DEINTERLEAVE(s32, int32_t, next_rand() << 8, 1.0f / 2147483648.0f)
+
+int main(void)
+{
+	for (int level = AUDIO_KERNEL_SCALAR; level <= AUDIO_KERNEL_AVX2; level++) {
+		enum audio_kernel_level selected = audio_kernels_select((enum audio_kernel_level)level);
+		if ((int)selected != level)
+			break;
+
+		printf("checking %s kernels\n", audio_kernel_level_name(selected));
+		check_mix_float();
+		check_mix_s16();
+		check_mix_s32();
+		check_mix_fused();
+		check_deinterleave_float();
+		check_deinterleave_s16();
+		check_deinterleave_s32();
+	}
+
+	return test_result("audio-kernels");
+}
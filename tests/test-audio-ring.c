@@ -0,0 +1,182 @@
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include "audio-ring.h"
+#include "test-helpers.h"
+
+#define STRESS_CAPACITY 4096
+#define STRESS_RECORDS 500000
+#define STRESS_MAX_PAYLOAD 300
+
+struct stress_header {
+	uint32_t seq;
+	uint32_t size;
+};
+
+struct stress {
+	struct audio_ring_cursors cursors;
+	uint8_t *data;
+
+	/* written by the consumer only, read after the join */
+	uint32_t received;
+	uint32_t wraps;
+	int errors;
+};
+
+static inline uint32_t next_rand(uint32_t *state)
+{
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+/* the cursors are free running, so tail may never be ahead of head and head
+ * never more than a capacity ahead of tail */
+static inline bool cursors_valid(const struct audio_ring_cursors *cursors)
+{
+	uint32_t tail = audio_ring_load_acquire(&cursors->tail);
+	uint32_t head = audio_ring_load_acquire(&cursors->head);
+	return head - tail <= STRESS_CAPACITY;
+}
+
+static void *producer_thread(void *param)
+{
+	struct stress *s = param;
+	struct audio_ring ring;
+	uint32_t rand_state = 1;
+
+	audio_ring_attach(&ring, &s->cursors, s->data, STRESS_CAPACITY);
+
+	for (uint32_t seq = 0; seq < STRESS_RECORDS; seq++) {
+		uint32_t size = sizeof(struct stress_header) + next_rand(&rand_state) % STRESS_MAX_PAYLOAD;
+		struct stress_header *header;
+
+		while ((header = audio_ring_reserve(&ring, size)) == NULL)
+			sched_yield();
+
+		header->seq = seq;
+		header->size = size;
+		uint8_t *payload = (uint8_t *)(header + 1);
+		for (uint32_t i = 0; i < size - sizeof(*header); i++)
+			payload[i] = (uint8_t)(seq + i);
+
+		audio_ring_commit(&ring);
+	}
+
+	return NULL;
+}
+
+static void *consumer_thread(void *param)
+{
+	struct stress *s = param;
+	struct audio_ring ring;
+	size_t last_offset = 0;
+
+	audio_ring_attach(&ring, &s->cursors, s->data, STRESS_CAPACITY);
+
+	while (s->received < STRESS_RECORDS) {
+		uint32_t size;
+		const struct stress_header *header = audio_ring_peek(&ring, &size);
+
+		if (!cursors_valid(&s->cursors))
+			s->errors++;
+
+		if (!header) {
+			sched_yield();
+			continue;
+		}
+
+		/* records are read in place and never straddle the end */
+		size_t offset = (const uint8_t *)header - s->data;
+		if (offset + header->size > STRESS_CAPACITY || size < header->size)
+			s->errors++;
+
+		if (header->seq != s->received)
+			s->errors++;
+
+		const uint8_t *payload = (const uint8_t *)(header + 1);
+		for (uint32_t i = 0; i < header->size - sizeof(*header); i++) {
+			if (payload[i] != (uint8_t)(header->seq + i)) {
+				s->errors++;
+				break;
+			}
+		}
+
+		if (offset < last_offset)
+			s->wraps++;
+		last_offset = offset;
+
+		audio_ring_release(&ring);
+		s->received++;
+	}
+
+	return NULL;
+}
+
+static void test_stress(void)
+{
+	struct stress s;
+	pthread_t producer, consumer;
+
+	memset(&s, 0, sizeof(s));
+	s.data = calloc(1, STRESS_CAPACITY);
+	audio_ring_reset(&s.cursors);
+
+	REQUIRE(pthread_create(&consumer, NULL, consumer_thread, &s) == 0);
+	REQUIRE(pthread_create(&producer, NULL, producer_thread, &s) == 0);
+	pthread_join(producer, NULL);
+	pthread_join(consumer, NULL);
+
+	CHECK(s.errors == 0);
+	CHECK(s.received == STRESS_RECORDS);
+	CHECK(s.wraps > 0);
+	CHECK(s.cursors.head == s.cursors.tail);
+
+	free(s.data);
+}
+
+/* a record that does not fit in the tail space leaves a wrap marker behind
+ * and is placed at offset 0 */
+static void test_wrap_marker(void)
+{
+	struct audio_ring_cursors cursors;
+	struct audio_ring writer, reader;
+	uint8_t *data = calloc(1, 256);
+	uint32_t size;
+
+	audio_ring_reset(&cursors);
+	audio_ring_attach(&writer, &cursors, data, 256);
+	audio_ring_attach(&reader, &cursors, data, 256);
+
+	REQUIRE(audio_ring_reserve(&writer, 180) == data + sizeof(struct audio_ring_record));
+	audio_ring_commit(&writer);
+	REQUIRE(audio_ring_peek(&reader, &size) != NULL);
+	CHECK(size == 184);
+	audio_ring_release(&reader);
+
+	/* 192 bytes used, 64 left at the end, the record needs 80 */
+	uint8_t *payload = audio_ring_reserve(&writer, 72);
+	CHECK(payload == data + sizeof(struct audio_ring_record));
+	CHECK(((struct audio_ring_record *)(data + 192))->size == AUDIO_RING_WRAP_MARKER);
+	audio_ring_commit(&writer);
+	CHECK(audio_ring_used(&reader) == 64 + 80);
+
+	CHECK(audio_ring_peek(&reader, &size) == payload);
+	CHECK(size == 72);
+	audio_ring_release(&reader);
+	CHECK(audio_ring_used(&reader) == 0);
+
+	/* a record larger than the free space is refused, not overwritten */
+	CHECK(audio_ring_reserve(&writer, 160) != NULL);
+	audio_ring_commit(&writer);
+	CHECK(audio_ring_reserve(&writer, 80) == NULL);
+	CHECK(audio_ring_used(&reader) == 168);
+
+	free(data);
+}
+
+int main(void)
+{
+	test_wrap_marker();
+	test_stress();
+	return test_result("audio-ring");
+}
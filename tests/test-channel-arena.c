@@ -0,0 +1,103 @@
+#include <obs.h>
+#include "channel-arena.h"
+#include "audio-kernels.h"
+#include "test-helpers.h"
+
+#define PLANES 8
+#define PLANE_FRAMES 1024
+#define RING_FRAMES (1 << 17)
+
+/* the layout audio_channel_create carves: one ring per plane, and the
+ * mixer's output planes from an arena of their own */
+static void test_layout(void)
+{
+	struct channel_arena arena;
+	float *rings[PLANES];
+	long arenas = channel_arena_allocations();
+	long heap = shim_heap_allocations;
+	size_t block = channel_arena_block_size(RING_FRAMES * sizeof(float));
+
+	REQUIRE(channel_arena_init(&arena, PLANES * block));
+	CHECK(channel_arena_allocations() == arenas + 1);
+
+	for (size_t i = 0; i < PLANES; i++) {
+		rings[i] = channel_arena_alloc(&arena, RING_FRAMES * sizeof(float));
+		REQUIRE(rings[i] != NULL);
+		CHECK((uintptr_t)rings[i] % CHANNEL_ARENA_ALIGN == 0);
+		if (i)
+			CHECK((uint8_t *)rings[i] == (uint8_t *)rings[i - 1] + block);
+	}
+
+	/* the whole layout came from the one allocation */
+	CHECK(shim_heap_allocations == heap + 1);
+	CHECK(channel_arena_allocations() == arenas + 1);
+
+	/* the arena is full, and says so rather than overrunning */
+	CHECK(channel_arena_alloc(&arena, 1) == NULL);
+	CHECK((uint8_t *)rings[PLANES - 1] + RING_FRAMES * sizeof(float) <= arena.base + arena.capacity);
+
+	channel_arena_free(&arena);
+	CHECK(arena.mem == NULL);
+}
+
+/* odd sizes are rounded up so the next block still starts on a cache line */
+static void test_alignment(void)
+{
+	struct channel_arena arena;
+	size_t sizes[] = {1, 63, 64, 65, 1000, 4096 + 4};
+	size_t total = 0;
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		total += channel_arena_block_size(sizes[i]);
+
+	REQUIRE(channel_arena_init(&arena, total));
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		uint8_t *ptr = channel_arena_alloc(&arena, sizes[i]);
+		REQUIRE(ptr != NULL);
+		CHECK((uintptr_t)ptr % CHANNEL_ARENA_ALIGN == 0);
+		memset(ptr, 0xAB, sizes[i]);
+	}
+	CHECK(arena.used == total);
+	channel_arena_free(&arena);
+}
+
+/* mixing ticks into arena planes never touches the heap; the arena
+ * counter only moves when a channel is created */
+static void test_no_tick_allocations(void)
+{
+	struct channel_arena arena;
+	float *out[2];
+	float *src[4];
+	size_t block = channel_arena_block_size(PLANE_FRAMES * sizeof(float));
+
+	audio_kernels_init();
+	REQUIRE(channel_arena_init(&arena, 6 * block));
+	for (size_t i = 0; i < 2; i++)
+		out[i] = channel_arena_alloc(&arena, PLANE_FRAMES * sizeof(float));
+	for (size_t i = 0; i < 4; i++) {
+		src[i] = channel_arena_alloc(&arena, PLANE_FRAMES * sizeof(float));
+		for (size_t f = 0; f < PLANE_FRAMES; f++)
+			src[i][f] = (float)f / PLANE_FRAMES;
+	}
+
+	long arenas = channel_arena_allocations();
+	long heap = shim_heap_allocations;
+
+	for (int tick = 0; tick < 10000; tick++) {
+		for (size_t p = 0; p < 2; p++)
+			audio_mix_fused(out[p], (const float *const *)src, 4, PLANE_FRAMES);
+	}
+
+	CHECK(channel_arena_allocations() == arenas);
+	CHECK(shim_heap_allocations == heap);
+	CHECK(out[0][PLANE_FRAMES - 1] == 1.0f);
+	channel_arena_free(&arena);
+}
+
+int main(void)
+{
+	test_layout();
+	test_alignment();
+	test_no_tick_allocations();
+	return test_result("channel-arena");
+}
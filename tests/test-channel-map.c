@@ -0,0 +1,158 @@
+#include <util/bmem.h>
+#include "channel-map.h"
+#include "test-helpers.h"
+
+/* the channels are only compared, never dereferenced */
+#define POOL_KEYS 200
+static char channels[POOL_KEYS];
+static uint64_t keys[POOL_KEYS];
+
+static inline struct audio_channel *channel_of(size_t i)
+{
+	return (struct audio_channel *)&channels[i];
+}
+
+static uint32_t rand_state = 7;
+
+static inline uint32_t next_rand(void)
+{
+	rand_state = rand_state * 1664525u + 1013904223u;
+	return rand_state >> 8;
+}
+
+static void check_invariants(const struct channel_map *map)
+{
+	size_t live = 0, removed = 0;
+
+	CHECK((map->capacity & (map->capacity - 1)) == 0);
+	CHECK((map->count + map->removed) * 4 <= map->capacity * 3);
+
+	for (size_t i = 0; i < map->capacity; i++) {
+		if (map->entries[i].key && map->entries[i].channel)
+			live++;
+		else if (map->entries[i].key)
+			removed++;
+	}
+	CHECK(live == map->count);
+	CHECK(removed == map->removed);
+}
+
+static void test_basics(void)
+{
+	struct channel_map map;
+	channel_map_init(&map);
+
+	CHECK(channel_map_find(&map, 1) == NULL);
+	CHECK(!channel_map_remove(&map, 1));
+
+	/* 0 is the empty slot marker and a missing channel the removed one */
+	channel_map_insert(&map, 0, channel_of(0));
+	channel_map_insert(&map, 1, NULL);
+	CHECK(map.count == 0);
+	CHECK(channel_map_find(&map, 0) == NULL);
+
+	channel_map_insert(&map, 0x1000, channel_of(0));
+	channel_map_insert(&map, 0x1000, channel_of(1));
+	CHECK(map.count == 1);
+	CHECK(channel_map_find(&map, 0x1000) == channel_of(1));
+
+	/* in a map with nothing else in it the key lands on its own
+	 * removed slot again */
+	CHECK(channel_map_remove(&map, 0x1000));
+	CHECK(!channel_map_remove(&map, 0x1000));
+	CHECK(channel_map_find(&map, 0x1000) == NULL);
+	CHECK(map.count == 0 && map.removed == 1);
+
+	channel_map_insert(&map, 0x1000, channel_of(2));
+	CHECK(map.count == 1 && map.removed == 0);
+	CHECK(channel_map_find(&map, 0x1000) == channel_of(2));
+
+	check_invariants(&map);
+	channel_map_free(&map);
+	CHECK(map.entries == NULL && map.capacity == 0);
+}
+
+/* streams come and go all the time while only a few are alive, so removed
+ * slots must be reused or compacted away rather than grow the table */
+static void test_compaction(void)
+{
+	struct channel_map map;
+	uint64_t next_key = 0x10000;
+
+	channel_map_init(&map);
+
+	for (int round = 0; round < 1000; round++) {
+		uint64_t first = next_key;
+
+		for (size_t i = 0; i < 8; i++, next_key += 0x40)
+			channel_map_insert(&map, next_key, channel_of(i));
+		for (uint64_t key = first; key < next_key; key += 0x40)
+			CHECK(channel_map_remove(&map, key));
+
+		check_invariants(&map);
+	}
+
+	CHECK(map.count == 0);
+	CHECK(map.capacity == 16);
+	channel_map_free(&map);
+}
+
+/* random inserts and removes of heap pointer like keys checked against a
+ * plain array, the table passes the 3/4 threshold many times over */
+static void test_churn(void)
+{
+	struct audio_channel *expected[POOL_KEYS] = {0};
+	struct channel_map map;
+	size_t live = 0, max_capacity = 0;
+
+	for (size_t i = 0; i < POOL_KEYS; i++)
+		keys[i] = 0x7FF000000000ULL + (uint64_t)(next_rand() & 0xFFFFF) * 0x30 + i * 0x10;
+
+	channel_map_init(&map);
+
+	for (int op = 0; op < 200000; op++) {
+		size_t i = next_rand() % POOL_KEYS;
+
+		if (next_rand() % 3 != 0 || !expected[i]) {
+			if (!expected[i])
+				live++;
+			expected[i] = channel_of(next_rand() % POOL_KEYS);
+			channel_map_insert(&map, keys[i], expected[i]);
+		} else {
+			CHECK(channel_map_remove(&map, keys[i]));
+			expected[i] = NULL;
+			live--;
+		}
+
+		if (op % 97 == 0) {
+			for (size_t k = 0; k < POOL_KEYS; k++)
+				CHECK(channel_map_find(&map, keys[k]) == expected[k]);
+			check_invariants(&map);
+		}
+
+		CHECK(map.count == live);
+		if (map.capacity > max_capacity)
+			max_capacity = map.capacity;
+	}
+
+	/* 200 keys at most need 512 slots */
+	CHECK(max_capacity <= 512);
+
+	for (size_t k = 0; k < POOL_KEYS; k++) {
+		if (expected[k])
+			CHECK(channel_map_remove(&map, keys[k]));
+		CHECK(channel_map_find(&map, keys[k]) == NULL);
+	}
+	CHECK(map.count == 0);
+
+	channel_map_free(&map);
+}
+
+int main(void)
+{
+	test_basics();
+	test_compaction();
+	test_churn();
+
+	return test_result("channel-map");
+}
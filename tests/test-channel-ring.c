@@ -0,0 +1,352 @@
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include "channel-ring.h"
+#include "test-helpers.h"
+
+#define STRESS_PLANES 2
+#define STRESS_FRAMES 40000000U
+#define STRESS_MAX_PACKET 256
+#define STRESS_MAX_READ 512
+
+/* frame n holds n in the first plane and its negation in the second, floats
+ * are exact up to 24 bits */
+static inline float frame_value(uint32_t pos, size_t plane)
+{
+	float val = (float)(pos & 0xFFFFFF);
+	return plane ? -val - 1.0f : val;
+}
+
+/* every field is derived from write_pos, so a copy that mixes two publishes
+ * is caught */
+static inline void derive_meta(struct audio_channel_meta *meta, uint32_t write_pos)
+{
+	meta->write_pos = write_pos;
+	meta->segment = write_pos / 4096;
+	meta->seg_pos = write_pos ^ 0x55555555;
+	meta->reserved = ~write_pos;
+	meta->seg_ts = (uint64_t)write_pos * 3 + ((uint64_t)meta->segment << 32);
+	meta->delay = ~meta->seg_ts;
+}
+
+static inline bool meta_consistent(const struct audio_channel_meta *meta)
+{
+	struct audio_channel_meta expected;
+	derive_meta(&expected, meta->write_pos);
+	return memcmp(&expected, meta, sizeof(expected)) == 0;
+}
+
+static inline uint32_t next_rand(uint32_t *state)
+{
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+struct stress {
+	struct channel_ring ring;
+	volatile uint32_t done;
+
+	/* each written by one side only, read after the join */
+	int producer_errors;
+	int consumer_errors;
+	uint32_t consumed;
+	uint32_t clears;
+	uint32_t meta_misses;
+	uint32_t wrapped_spans;
+};
+
+static void write_frames(struct channel_ring *ring, uint32_t pos, size_t frames)
+{
+	size_t first = channel_ring_first_run(pos, frames);
+
+	for (size_t p = 0; p < ring->num_planes; p++) {
+		float *plane = ring->planes[p];
+
+		for (size_t i = 0; i < frames; i++) {
+			uint32_t frame = pos + (uint32_t)i;
+			size_t offset = i < first ? (pos & AUDIO_CHANNEL_RING_MASK) + i : i - first;
+			plane[offset] = frame_value(frame, p);
+		}
+	}
+}
+
+static void *producer_thread(void *param)
+{
+	struct stress *s = param;
+	struct audio_channel_meta meta;
+	uint32_t rand_state = 1;
+	uint32_t resets_seen = 0;
+	uint32_t pos = 0;
+
+	while (!audio_ring_load_acquire(&s->done)) {
+		size_t frames = 1 + next_rand(&rand_state) % STRESS_MAX_PACKET;
+
+		if (channel_ring_fill(&s->ring, pos) > AUDIO_CHANNEL_RING_FRAMES)
+			s->producer_errors++;
+
+		if (frames > channel_ring_space(&s->ring, pos)) {
+			sched_yield();
+			continue;
+		}
+
+		write_frames(&s->ring, pos, frames);
+		pos += (uint32_t)frames;
+
+		derive_meta(&meta, pos);
+		channel_ring_publish(&s->ring, &meta);
+
+		uint32_t resets = channel_ring_resets(&s->ring);
+		if (resets < resets_seen)
+			s->producer_errors++;
+		resets_seen = resets;
+	}
+
+	return NULL;
+}
+
+static bool check_span(struct stress *s, size_t plane, uint32_t pos, size_t frames)
+{
+	const float *begin = s->ring.planes[plane];
+	const float *end = begin + AUDIO_CHANNEL_RING_FRAMES;
+	struct audio_span span;
+
+	channel_ring_peek(&s->ring, plane, frames, &span);
+
+	if (span.frames[0] + span.frames[1] != frames)
+		return false;
+	if (span.data[0] < begin || span.data[0] + span.frames[0] > end)
+		return false;
+	if (span.frames[1])
+		s->wrapped_spans++;
+
+	for (size_t run = 0; run < 2; run++) {
+		for (size_t i = 0; i < span.frames[run]; i++) {
+			if (span.data[run][i] != frame_value(pos++, plane))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static void *consumer_thread(void *param)
+{
+	struct stress *s = param;
+	struct audio_channel_meta meta;
+	uint32_t rand_state = 2;
+	uint32_t last_write = 0;
+	uint32_t iteration = 0;
+
+	while (s->consumed < STRESS_FRAMES) {
+		if (!channel_ring_read_meta(&s->ring, &meta)) {
+			s->meta_misses++;
+			continue;
+		}
+
+		if (!meta_consistent(&meta))
+			s->consumer_errors++;
+		if ((int32_t)(meta.write_pos - last_write) < 0)
+			s->consumer_errors++;
+		last_write = meta.write_pos;
+
+		/* read_pos never passes the published write_pos, and write_pos
+		 * is never more than the ring ahead of it */
+		uint32_t pos = s->ring.read_pos;
+		uint32_t fill = meta.write_pos - pos;
+		if (fill > AUDIO_CHANNEL_RING_FRAMES) {
+			s->consumer_errors++;
+			break;
+		}
+
+		/* now and then the mixer drops everything, like a stalled
+		 * stream does */
+		if (++iteration % 1000 == 0) {
+			channel_ring_clear(&s->ring, meta.write_pos);
+			s->consumed += fill;
+			s->clears++;
+			continue;
+		}
+
+		if (!fill) {
+			sched_yield();
+			continue;
+		}
+
+		size_t frames = next_rand(&rand_state) % (fill < STRESS_MAX_READ ? fill + 1 : STRESS_MAX_READ);
+		for (size_t p = 0; p < STRESS_PLANES; p++) {
+			if (!check_span(s, p, pos, frames))
+				s->consumer_errors++;
+		}
+
+		channel_ring_release(&s->ring, pos + (uint32_t)frames);
+		s->consumed += (uint32_t)frames;
+	}
+
+	audio_ring_store_release(&s->done, 1);
+	return NULL;
+}
+
+static void init_ring(struct channel_ring *ring, struct audio_channel_meta *meta)
+{
+	memset(ring, 0, sizeof(*ring));
+	ring->num_planes = STRESS_PLANES;
+	for (size_t p = 0; p < STRESS_PLANES; p++)
+		ring->planes[p] = calloc(AUDIO_CHANNEL_RING_FRAMES, sizeof(float));
+
+	channel_ring_reset(ring, meta);
+}
+
+static void free_ring(struct channel_ring *ring)
+{
+	for (size_t p = 0; p < STRESS_PLANES; p++)
+		free(ring->planes[p]);
+}
+
+static void test_stress(void)
+{
+	struct audio_channel_meta meta;
+	pthread_t producer, consumer;
+	struct stress s;
+
+	memset(&s, 0, sizeof(s));
+	derive_meta(&meta, 0);
+	init_ring(&s.ring, &meta);
+
+	REQUIRE(pthread_create(&consumer, NULL, consumer_thread, &s) == 0);
+	REQUIRE(pthread_create(&producer, NULL, producer_thread, &s) == 0);
+	pthread_join(consumer, NULL);
+	pthread_join(producer, NULL);
+
+	printf("consumed %u frames, %u clears, %u wrapped spans, %u meta reads retried\n", s.consumed, s.clears, s.wrapped_spans,
+	       s.meta_misses);
+
+	CHECK(s.producer_errors == 0);
+	CHECK(s.consumer_errors == 0);
+	CHECK(s.consumed >= STRESS_FRAMES);
+	CHECK(s.clears > 0);
+	CHECK(s.wrapped_spans > 0);
+
+	free_ring(&s.ring);
+}
+
+/* a packet over the end of the buffer is read back as two runs */
+static void test_wrap(void)
+{
+	struct audio_channel_meta meta = {0};
+	struct channel_ring ring;
+	struct audio_span span;
+	uint32_t pos = AUDIO_CHANNEL_RING_FRAMES * 3 - 3;
+
+	init_ring(&ring, &meta);
+	channel_ring_release(&ring, pos);
+
+	CHECK(channel_ring_space(&ring, pos) == AUDIO_CHANNEL_RING_FRAMES);
+	CHECK(channel_ring_first_run(pos, 10) == 3);
+	write_frames(&ring, pos, 10);
+	CHECK(channel_ring_space(&ring, pos + 10) == AUDIO_CHANNEL_RING_FRAMES - 10);
+
+	channel_ring_peek(&ring, 1, 10, &span);
+	CHECK(span.data[0] == ring.planes[1] + AUDIO_CHANNEL_RING_FRAMES - 3);
+	CHECK(span.frames[0] == 3);
+	CHECK(span.data[1] == ring.planes[1]);
+	CHECK(span.frames[1] == 7);
+	CHECK(span.data[0][2] == frame_value(pos + 2, 1));
+	CHECK(span.data[1][0] == frame_value(pos + 3, 1));
+
+	channel_ring_clear(&ring, pos + 10);
+	CHECK(channel_ring_fill(&ring, pos + 10) == 0);
+	CHECK(channel_ring_resets(&ring) == 1);
+
+	free_ring(&ring);
+}
+
+/* a producer stuck between the two halves of a publish must not hang the
+ * mixer, the read gives up and leaves the previous copy alone */
+static void test_stuck_publish(void)
+{
+	struct audio_channel_meta meta, seen;
+	struct channel_ring ring;
+
+	derive_meta(&meta, 100);
+	init_ring(&ring, &meta);
+
+	CHECK(channel_ring_read_meta(&ring, &seen));
+	CHECK(memcmp(&seen, &meta, sizeof(meta)) == 0);
+
+	ring.seq = 1;
+	derive_meta(&ring.meta, 200);
+	CHECK(!channel_ring_read_meta(&ring, &seen));
+	CHECK(seen.write_pos == 100);
+
+	ring.seq = 2;
+	CHECK(channel_ring_read_meta(&ring, &seen));
+	CHECK(seen.write_pos == 200);
+
+	free_ring(&ring);
+}
+
+/* largest step between neighbouring samples of a 1 kHz sine that is cut
+ * by skip frames at pos, both around the cut and on through the fade */
+static float max_step_over_cut(size_t skip, size_t fade)
+{
+	struct audio_channel_meta meta = {0};
+	struct channel_ring ring;
+	uint32_t pos = AUDIO_CHANNEL_RING_FRAMES - 40;
+	float orig[512];
+	float max_step = 0.0f;
+
+	init_ring(&ring, &meta);
+	for (uint32_t i = 0; i < 512; i++) {
+		orig[i] = sinf((float)i * 2.0f * 3.14159265f * 1000.0f / 48000.0f);
+		ring.planes[0][(pos - 1 + i) & AUDIO_CHANNEL_RING_MASK] = orig[i];
+		ring.planes[1][(pos - 1 + i) & AUDIO_CHANNEL_RING_MASK] = -orig[i];
+	}
+
+	channel_ring_release(&ring, pos);
+	channel_ring_crossfade(&ring, skip, fade);
+	channel_ring_release(&ring, pos + (uint32_t)skip);
+
+	/* the frames before the cut and far past the fade are untouched,
+	 * inside it the output stays between the two timelines */
+	float prev = orig[0];
+	for (uint32_t i = 0; i < 300; i++) {
+		float cur = ring.planes[0][(pos + (uint32_t)skip + i) & AUDIO_CHANNEL_RING_MASK];
+		float old = orig[1 + i], next = orig[1 + skip + i];
+
+		CHECK(ring.planes[1][(pos + (uint32_t)skip + i) & AUDIO_CHANNEL_RING_MASK] == -cur);
+		if (i >= fade)
+			CHECK(cur == next);
+		else
+			CHECK(cur >= fminf(old, next) - 1e-6f && cur <= fmaxf(old, next) + 1e-6f);
+
+		if (fabsf(cur - prev) > max_step)
+			max_step = fabsf(cur - prev);
+		prev = cur;
+	}
+
+	free_ring(&ring);
+	return max_step;
+}
+
+/* the drain cut a third of a period out of a sine: without the fade that
+ * is a jump of most of its amplitude, with it no step is much larger than
+ * the sine's own */
+static void test_crossfade(void)
+{
+	float natural = 2.0f * 3.14159265f * 1000.0f / 48000.0f;
+
+	CHECK(max_step_over_cut(16, 0) > 0.6f);
+	CHECK(max_step_over_cut(16, 128) < natural * 1.2f);
+	CHECK(max_step_over_cut(200, 128) < natural * 1.2f);
+}
+
+int main(void)
+{
+	test_wrap();
+	test_crossfade();
+	test_stuck_publish();
+	test_stress();
+
+	return test_result("channel-ring");
+}
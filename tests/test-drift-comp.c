@@ -0,0 +1,125 @@
+#include <math.h>
+#include "drift-comp.h"
+#include "test-helpers.h"
+
+/* a target rendering 10 ms packets on a device clock that is off by some
+ * ppm, drained by the mixer in 1024 frame ticks on the obs clock */
+#define SAMPLE_RATE 48000
+#define PACKET_FRAMES 480
+#define TICK_FRAMES 1024
+#define PREFILL_FRAMES 2048
+#define SIM_SECONDS 900
+
+/* the estimate is judged over the last stretch, several of the loop's
+ * ~40 s time constants in, so even a large offset has settled */
+#define SETTLED_SECONDS 300
+
+struct sim_result {
+	double ppm_avg;
+	double integral;
+	double max_ppm;
+	double max_fill_error;
+	bool underrun;
+};
+
+static struct sim_result simulate(double injected_ppm)
+{
+	static float in[PACKET_FRAMES], out[PACKET_FRAMES * 2];
+	const float *src[1] = {in};
+	float *dst[1] = {out};
+	struct sim_result res = {0};
+	struct drift_comp dc;
+
+	uint64_t written = PREFILL_FRAMES, read = 0;
+	uint64_t packets = 0, ticks = 0;
+	double packet_period = (double)PACKET_FRAMES / ((double)SAMPLE_RATE * (1.0 + injected_ppm * 0.000001));
+	double tick_period = (double)TICK_FRAMES / SAMPLE_RATE;
+	double ppm_sum = 0.0;
+	uint64_t ppm_count = 0;
+
+	for (size_t i = 0; i < PACKET_FRAMES; i++)
+		in[i] = sinf((float)i * 0.05f);
+
+	drift_comp_init(&dc);
+
+	for (;;) {
+		double packet_time = (double)packets * packet_period;
+		double tick_time = (double)ticks * tick_period;
+
+		if (packet_time > SIM_SECONDS && tick_time > SIM_SECONDS)
+			break;
+
+		if (packet_time <= tick_time) {
+			drift_comp_update(&dc, (uint32_t)(written - read), PACKET_FRAMES, SAMPLE_RATE);
+
+			size_t frames = drift_comp_process(&dc, dst, src, 1, PACKET_FRAMES);
+			CHECK(frames <= drift_comp_max_output(PACKET_FRAMES));
+			written += frames;
+			packets++;
+
+			if (packet_time < SIM_SECONDS - SETTLED_SECONDS)
+				continue;
+
+			ppm_sum += dc.ppm;
+			ppm_count++;
+			if (fabs(dc.ppm) > res.max_ppm)
+				res.max_ppm = fabs(dc.ppm);
+			if (fabs(dc.fill - dc.target) > res.max_fill_error)
+				res.max_fill_error = fabs(dc.fill - dc.target);
+		} else {
+			if (written - read < TICK_FRAMES) {
+				res.underrun = true;
+				read = written;
+			} else {
+				read += TICK_FRAMES;
+			}
+			ticks++;
+		}
+	}
+
+	res.ppm_avg = ppm_sum / (double)ppm_count;
+	res.integral = dc.integral;
+	return res;
+}
+
+/* a fast producer fills the ring, so the correction has the same sign as
+ * the injected drift */
+static void check_tracks(double injected_ppm)
+{
+	struct sim_result res = simulate(injected_ppm);
+
+	printf("injected %+7.1f ppm: estimate %+8.2f ppm, integral %+8.2f ppm, fill error %6.2f frames\n", injected_ppm, res.ppm_avg,
+	       res.integral, res.max_fill_error);
+
+	CHECK(!res.underrun);
+	CHECK(fabs(res.ppm_avg - injected_ppm) < 2.0);
+	CHECK(fabs(res.integral - injected_ppm) < 5.0);
+	CHECK(res.max_fill_error < 32.0);
+}
+
+/* drift past the clamp can not be followed, the estimate has to stay at the
+ * limit rather than run away */
+static void check_clamped(double injected_ppm)
+{
+	struct sim_result res = simulate(injected_ppm);
+	double limit = injected_ppm > 0.0 ? 1000.0 : -1000.0;
+
+	printf("injected %+7.1f ppm: estimate %+8.2f ppm, integral %+8.2f ppm\n", injected_ppm, res.ppm_avg, res.integral);
+
+	CHECK(res.max_ppm <= 1000.0);
+	CHECK(res.integral == limit);
+	CHECK(fabs(res.ppm_avg - limit) < 1.0);
+}
+
+int main(void)
+{
+	check_tracks(0.0);
+	check_tracks(100.0);
+	check_tracks(-100.0);
+	check_tracks(500.0);
+	check_tracks(-500.0);
+	check_clamped(1500.0);
+	check_clamped(-1500.0);
+
+	return test_result("drift-comp");
+}
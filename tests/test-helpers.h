@@ -0,0 +1,34 @@
+#pragma once
+
+/* minimal checks for the standalone tests, which build without libobs and
+ * run on any platform but windows */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond)                                                                     \
+	do {                                                                            \
+		if (!(cond)) {                                                          \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			test_failures++;                                                \
+		}                                                                       \
+	} while (0)
+
+#define REQUIRE(cond)                                                                   \
+	do {                                                                            \
+		if (!(cond)) {                                                          \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			exit(1);                                                        \
+		}                                                                       \
+	} while (0)
+
+static inline int test_result(const char *name)
+{
+	if (test_failures)
+		fprintf(stderr, "%s: %d checks failed\n", name, test_failures);
+	else
+		printf("%s: ok\n", name);
+	return test_failures ? 1 : 0;
+}
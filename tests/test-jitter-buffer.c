@@ -0,0 +1,161 @@
+#include "jitter-buffer.h"
+#include "test-helpers.h"
+
+#define MS 1000000ULL
+
+static const struct jitter_params default_params = {
+	.min_delay = 0,
+	.max_delay = 100 * MS,
+	.margin = 2 * MS,
+	.percentile = 95,
+};
+
+/* feeds n packets with the same lateness and returns how often the delay
+ * changed, checking that it never shrinks by more than a step at a time */
+static int feed(struct jitter_buffer *jb, uint64_t lateness, int n)
+{
+	int changes = 0;
+
+	for (int i = 0; i < n; i++) {
+		uint64_t before = jitter_buffer_delay(jb);
+		bool changed = jitter_buffer_add_sample(jb, lateness);
+		uint64_t after = jitter_buffer_delay(jb);
+
+		CHECK(changed == (before != after));
+		if (after < before)
+			CHECK(before - after <= 1 * MS);
+		CHECK(jb->total < 2000);
+		changes += changed;
+	}
+
+	return changes;
+}
+
+/* a bucket counts up to its upper edge, so 5 ms late lands at 6 ms */
+static void test_settles_down_to_percentile(void)
+{
+	struct jitter_buffer jb;
+	jitter_buffer_init(&jb, &default_params);
+
+	CHECK(jitter_buffer_delay(&jb) == 100 * MS);
+
+	/* nothing is decided before the first update interval */
+	CHECK(feed(&jb, 5 * MS, 15) == 0);
+	CHECK(jitter_buffer_delay(&jb) == 100 * MS);
+
+	/* shrinks one step per update, so it takes 92 updates to reach 8 ms */
+	feed(&jb, 5 * MS, 1 + 16 * 90);
+	CHECK(jitter_buffer_delay(&jb) == 9 * MS);
+	feed(&jb, 5 * MS, 16);
+	CHECK(jitter_buffer_delay(&jb) == 8 * MS);
+
+	CHECK(feed(&jb, 5 * MS, 16 * 10) == 0);
+	CHECK(jitter_buffer_delay(&jb) == 8 * MS);
+}
+
+static void test_grows_immediately(void)
+{
+	struct jitter_buffer jb;
+	jitter_buffer_init(&jb, &default_params);
+
+	feed(&jb, 0, 16 * 100);
+	CHECK(jitter_buffer_delay(&jb) == 3 * MS);
+
+	/* 1600 on time packets, 95% is covered until more than 84 are late */
+	feed(&jb, 30 * MS, 80);
+	CHECK(jitter_buffer_delay(&jb) == 3 * MS);
+
+	/* the next update sees the tail and jumps straight to it */
+	int changes = feed(&jb, 30 * MS, 16);
+	CHECK(changes == 1);
+	CHECK(jitter_buffer_delay(&jb) == 33 * MS);
+}
+
+static void test_percentile(void)
+{
+	struct jitter_params params = default_params;
+	struct jitter_buffer jb;
+
+	/* 10% of the packets are late by 20 ms */
+	params.percentile = 95;
+	jitter_buffer_init(&jb, &params);
+	for (int i = 0; i < 150; i++) {
+		feed(&jb, 2 * MS, 9);
+		feed(&jb, 20 * MS, 1);
+	}
+	CHECK(jitter_buffer_delay(&jb) == 23 * MS);
+
+	params.percentile = 85;
+	jitter_buffer_init(&jb, &params);
+	for (int i = 0; i < 200; i++) {
+		feed(&jb, 2 * MS, 9);
+		feed(&jb, 20 * MS, 1);
+	}
+	CHECK(jitter_buffer_delay(&jb) == 5 * MS);
+}
+
+static void test_bounds(void)
+{
+	struct jitter_params params = default_params;
+	struct jitter_buffer jb;
+
+	/* later than the last bucket counts as the last bucket, and the
+	 * delay still stops at the upper bound */
+	jitter_buffer_init(&jb, &params);
+	feed(&jb, 10000 * MS, 16);
+	CHECK(jb.histogram[JITTER_BUCKETS - 1] == 16);
+	CHECK(jitter_buffer_delay(&jb) == 100 * MS);
+
+	/* on time packets still get the lower bound */
+	params.min_delay = 10 * MS;
+	jitter_buffer_init(&jb, &params);
+	feed(&jb, 0, 16 * 200);
+	CHECK(jitter_buffer_delay(&jb) == 10 * MS);
+
+	/* changed bounds apply to the current delay right away */
+	params.min_delay = 20 * MS;
+	jitter_buffer_set_params(&jb, &params);
+	CHECK(jitter_buffer_delay(&jb) == 20 * MS);
+
+	params.min_delay = 0;
+	params.max_delay = 5 * MS;
+	jitter_buffer_set_params(&jb, &params);
+	CHECK(jitter_buffer_delay(&jb) == 5 * MS);
+}
+
+/* a burst of late packets raises the delay, and once it is old enough for
+ * the decay to have halved it below the percentile the delay comes back */
+static void test_decays(void)
+{
+	struct jitter_buffer jb;
+	jitter_buffer_init(&jb, &default_params);
+
+	feed(&jb, 1 * MS, 16 * 100);
+	CHECK(jitter_buffer_delay(&jb) == 4 * MS);
+
+	feed(&jb, 40 * MS, 16 * 10);
+	CHECK(jitter_buffer_delay(&jb) == 43 * MS);
+
+	/* still within the histogram's memory */
+	feed(&jb, 1 * MS, 16 * 20);
+	CHECK(jitter_buffer_delay(&jb) == 43 * MS);
+
+	int n = 0;
+	while (jitter_buffer_delay(&jb) != 4 * MS && n < 10000) {
+		feed(&jb, 1 * MS, 16);
+		n += 16;
+	}
+	CHECK(jitter_buffer_delay(&jb) == 4 * MS);
+	printf("delay back down after %d on time packets\n", n);
+}
+
+int main(void)
+{
+	test_settles_down_to_percentile();
+	test_grows_immediately();
+	test_percentile();
+	test_bounds();
+	test_decays();
+
+	return test_result("jitter-buffer");
+}
@@ -0,0 +1,171 @@
+#include <string.h>
+#include "mix-scheduler.h"
+#include "test-helpers.h"
+
+#define SAMPLE_RATE 48000
+#define TICK_FRAMES 1024
+
+/* 1024 frames at 48 kHz, 21.333 ms, which is exactly what whole millisecond
+ * sleeps used to round away */
+#define TICK_NS (TICK_FRAMES * 1000000000ULL / SAMPLE_RATE)
+
+/* time only moves when the scheduler sleeps or the test says so, sleeping
+ * oversleeps by a fixed wakeup latency */
+struct fake_clock {
+	uint64_t now;
+	uint64_t latency;
+	size_t sleeps;
+};
+
+static uint64_t fake_now(void *param)
+{
+	struct fake_clock *fake = param;
+	return fake->now;
+}
+
+static void fake_sleep_until(void *param, uint64_t deadline)
+{
+	struct fake_clock *fake = param;
+
+	if (deadline > fake->now)
+		fake->now = deadline;
+	fake->now += fake->latency;
+	fake->sleeps++;
+}
+
+static void init_fake(struct mix_scheduler *sched, struct fake_clock *fake, uint64_t start)
+{
+	struct mix_clock clock = {fake_now, fake_sleep_until, fake};
+
+	memset(fake, 0, sizeof(*fake));
+	fake->now = start;
+	mix_scheduler_init(sched, &clock, SAMPLE_RATE, TICK_FRAMES);
+}
+
+static size_t run_ticks(struct mix_scheduler *sched, size_t due)
+{
+	for (size_t i = 0; i < due; i++)
+		mix_scheduler_advance(sched);
+	return due;
+}
+
+/* deadlines come from the frame count, so a long run ends exactly where
+ * the sample clock says and sub millisecond wakeup latency is not late */
+static void test_on_time(void)
+{
+	struct mix_scheduler sched;
+	struct fake_clock fake;
+	size_t ticks = 0;
+
+	init_fake(&sched, &fake, 5000);
+	fake.latency = 200000;
+
+	while (ticks < 4500)
+		ticks += run_ticks(&sched, mix_scheduler_wait(&sched));
+
+	CHECK(ticks == 4500);
+	CHECK(sched.stats.ticks == 4500);
+	CHECK(sched.stats.late_ticks == 0);
+	CHECK(sched.stats.bursts == 0);
+	CHECK(sched.stats.early_ticks == 0);
+
+	/* 4500 ticks are 96 s of audio, with no rounding carried along */
+	CHECK(sched.deadline == 5000 + 96000000000ULL);
+}
+
+/* a stall of several ticks is reported as late once and caught up in one
+ * burst, after which the schedule continues from the original timeline */
+static void test_late_and_catch_up(void)
+{
+	struct mix_scheduler sched;
+	struct fake_clock fake;
+	size_t due;
+
+	init_fake(&sched, &fake, 0);
+	for (int i = 0; i < 10; i++)
+		run_ticks(&sched, mix_scheduler_wait(&sched));
+
+	uint64_t deadline = sched.deadline;
+	fake.now = deadline + 3 * TICK_NS + TICK_NS / 2;
+
+	due = mix_scheduler_wait(&sched);
+	CHECK(due == 4);
+	CHECK(sched.stats.late_ticks == 1);
+	CHECK(sched.stats.max_lateness == 3 * TICK_NS + TICK_NS / 2);
+	CHECK(sched.stats.bursts == 1);
+	CHECK(sched.stats.catch_up_ticks == 3);
+	CHECK(sched.stats.max_burst == 4);
+	run_ticks(&sched, due);
+
+	/* back on schedule: the next tick sleeps to its own deadline */
+	size_t sleeps = fake.sleeps;
+	CHECK(mix_scheduler_wait(&sched) == 1);
+	CHECK(fake.sleeps == sleeps + 1);
+	CHECK(fake.now == sched.deadline);
+	CHECK(sched.stats.bursts == 1);
+	CHECK(sched.stats.late_ticks == 1);
+	CHECK(sched.stats.ticks == 15);
+}
+
+struct ready_state {
+	struct fake_clock *fake;
+	bool ready;
+	size_t calls;
+	uint64_t called_at;
+};
+
+static bool fake_ready(void *param, uint64_t deadline)
+{
+	struct ready_state *state = param;
+
+	state->calls++;
+	state->called_at = state->fake->now;
+	if (!state->ready)
+		state->fake->now = deadline;
+	return state->ready;
+}
+
+/* with the input ready a tick runs up to one tick ahead of its deadline,
+ * never more, and without it the timer drives the tick */
+static void test_early(void)
+{
+	struct mix_scheduler sched;
+	struct fake_clock fake;
+	struct ready_state state = {&fake, true, 0, 0};
+
+	init_fake(&sched, &fake, 1000);
+	run_ticks(&sched, mix_scheduler_wait(&sched));
+	run_ticks(&sched, mix_scheduler_wait(&sched));
+
+	/* the previous tick ran on time, so this one may start right away */
+	uint64_t deadline = sched.deadline;
+	CHECK(mix_scheduler_wait_ready(&sched, fake_ready, &state) == 1);
+	CHECK(state.calls == 1);
+	CHECK(fake.now < deadline);
+	CHECK(sched.stats.early_ticks == 1);
+	run_ticks(&sched, 1);
+
+	/* the next one is two ticks out and waits until it is one tick out */
+	deadline = sched.deadline;
+	CHECK(mix_scheduler_wait_ready(&sched, fake_ready, &state) == 1);
+	CHECK(state.called_at == deadline - TICK_NS);
+	CHECK(sched.stats.early_ticks == 2);
+	run_ticks(&sched, 1);
+
+	/* input stalled: the deadline passes and the tick is a normal one */
+	state.ready = false;
+	deadline = sched.deadline;
+	CHECK(mix_scheduler_wait_ready(&sched, fake_ready, &state) == 1);
+	CHECK(fake.now == deadline);
+	CHECK(sched.stats.early_ticks == 2);
+	CHECK(sched.stats.late_ticks == 0);
+	CHECK(sched.stats.ticks == 5);
+}
+
+int main(void)
+{
+	test_on_time();
+	test_late_and_catch_up();
+	test_early();
+	return test_result("mix-scheduler");
+}
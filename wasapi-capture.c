@@ -1,11 +1,31 @@
 #include <windows.h>
 #include <psapi.h>
+#include <math.h>
 #include <obs-module.h>
 #include "app-helpers.h"
 #include "../../libobs/util/windows/obfuscate.h"
 #include "wasapi-capture.h"
+#include "audio-kernels.h"
+#include "mix-scheduler.h"
 
 #define SETTING_CAPTURE_PROCESS "process"
+#define SETTING_JITTER_MIN "jitter_min_ms"
+#define SETTING_JITTER_MAX "jitter_max_ms"
+#define SETTING_JITTER_PERCENTILE "jitter_percentile"
+#define SETTING_JITTER_MARGIN "jitter_margin_ms"
+#define SETTING_CHANNEL_TIMEOUT "channel_timeout_s"
+#define SETTING_LOW_LATENCY "low_latency_mix"
+
+#define DEFAULT_JITTER_MIN 10
+#define DEFAULT_JITTER_MAX 200
+#define DEFAULT_JITTER_PERCENTILE 95
+#define DEFAULT_JITTER_MARGIN 5
+#define DEFAULT_CHANNEL_TIMEOUT 10
+
+/* idle channels are looked for once a second, and at most this many evicted
+ * channels are kept around for reuse */
+#define CHANNEL_EVICT_INTERVAL 1000000000ULL
+#define CHANNEL_POOL_SIZE 8
 
 #define DEFAULT_RETRY_INTERVAL 2.0f
 #define ERROR_RETRY_INTERVAL 4.0f
@@ -13,6 +33,15 @@
 #define DEBUG_AUDIO 0
 #define MAX_BUFFERING_TICKS 45
 
+/* buffering is only drained after every active channel kept more than a
+ * tick of data beyond the mix window for this many ticks (~10 s at 48 kHz),
+ * and then by skipping this many frames per tick.  each cut is crossfaded
+ * over the fade frames after it, which the headroom check guarantees are
+ * queued */
+#define BUFFERING_DRAIN_CHECK_TICKS 470
+#define BUFFERING_DRAIN_STEP_FRAMES 16
+#define BUFFERING_DRAIN_FADE_FRAMES 128
+
 struct wasapi_offset offsets32 = {0};
 struct wasapi_offset offsets64 = {0};
 
@@ -58,33 +87,39 @@ static bool check_file_integrity(struct wasapi_capture *wc, const char *file, co
 	return false;
 }
 
-static inline void find_min_ts(struct wasapi_capture *wc, uint64_t *min_ts)
+static inline void find_min_ts(const struct channel_list *list, uint64_t *min_ts)
 {
-	for (size_t i = 0; i < wc->audio_channels.num; i++) {
-		struct audio_channel *source = wc->audio_channels.array[i].channel;
+	for (size_t i = 0; i < list->num; i++) {
+		struct audio_channel *source = list->array[i];
 		if (!source->audio_pending && source->audio_ts && source->audio_ts < *min_ts) {
 			*min_ts = source->audio_ts;
 		}
 	}
 }
 
-static inline bool mark_invalid_sources(struct wasapi_capture *wc, size_t sample_rate, uint64_t min_ts)
+static inline bool mark_invalid_sources(const struct channel_list *list, size_t sample_rate, uint64_t min_ts)
 {
 	bool recalculate = false;
 
-	for (size_t i = 0; i < wc->audio_channels.num; i++) {
-		struct audio_channel *source = wc->audio_channels.array[i].channel;
+	for (size_t i = 0; i < list->num; i++) {
+		struct audio_channel *source = list->array[i];
 		recalculate |= audio_channel_audio_buffer_insuffient(source, sample_rate, min_ts);
 	}
 
 	return recalculate;
 }
 
-static inline void calc_min_ts(struct wasapi_capture *wc, size_t sample_rate, uint64_t *min_ts)
+static inline void calc_min_ts(const struct channel_list *list, size_t sample_rate, uint64_t *min_ts)
+{
+	find_min_ts(list, min_ts);
+	if (mark_invalid_sources(list, sample_rate, *min_ts))
+		find_min_ts(list, min_ts);
+}
+
+static inline void update_buffering_stats(struct wasapi_capture *wc, size_t sample_rate)
 {
-	find_min_ts(wc, min_ts);
-	if (mark_invalid_sources(wc, sample_rate, *min_ts))
-		find_min_ts(wc, min_ts);
+	uint64_t frames = (uint64_t)wc->total_buffering_ticks * AUDIO_OUTPUT_FRAMES - wc->drain_frames;
+	os_atomic_set_long(&wc->stats.buffering_ms, (long)(frames * 1000 / sample_rate));
 }
 
 static void wasapi_capture_add_audio_buffering(struct wasapi_capture *wc, size_t sample_rate, struct ts_info *ts, uint64_t min_ts)
@@ -92,6 +127,7 @@ static void wasapi_capture_add_audio_buffering(struct wasapi_capture *wc, size_t
 	struct ts_info new_ts;
 	uint64_t offset;
 	uint64_t frames;
+	uint64_t shift;
 	size_t total_ms;
 	size_t ms;
 	int ticks;
@@ -99,8 +135,11 @@ static void wasapi_capture_add_audio_buffering(struct wasapi_capture *wc, size_t
 	if (wc->total_buffering_ticks == MAX_BUFFERING_TICKS)
 		return;
 
+	/* the queued timestamps do not include the drain offset */
+	shift = audio_frames_to_ns(sample_rate, wc->drain_frames);
+
 	if (!wc->buffering_wait_ticks)
-		wc->buffered_ts = ts->start;
+		wc->buffered_ts = ts->start - shift;
 
 	offset = ts->start - min_ts;
 	frames = ns_to_audio_frames(sample_rate, offset);
@@ -108,6 +147,11 @@ static void wasapi_capture_add_audio_buffering(struct wasapi_capture *wc, size_t
 
 	wc->total_buffering_ticks += ticks;
 
+	/* a source fell behind, so whatever headroom was seen is gone */
+	wc->draining = false;
+	wc->headroom_ticks = 0;
+	wc->min_headroom = UINT64_MAX;
+
 	if (wc->total_buffering_ticks >= MAX_BUFFERING_TICKS) {
 		ticks -= wc->total_buffering_ticks - MAX_BUFFERING_TICKS;
 		wc->total_buffering_ticks = MAX_BUFFERING_TICKS;
@@ -144,13 +188,73 @@ static void wasapi_capture_add_audio_buffering(struct wasapi_capture *wc, size_t
 		circlebuf_push_front(&wc->buffered_timestamps, &new_ts, sizeof(new_ts));
 	}
 
-	*ts = new_ts;
+	ts->start = new_ts.start + shift;
+	ts->end = new_ts.end + shift;
+	update_buffering_stats(wc, sample_rate);
 }
 
-static inline void wasapi_capture_mix_audio(struct audio_output_data *mixes, struct audio_channel *source, size_t channels, size_t sample_rate,
-					    struct ts_info *ts)
+/* called once per mixed tick with the smallest amount of data any active
+ * channel holds beyond the end of the window; returns true if the next
+ * window should be moved forward by a drain step */
+static bool check_buffering_headroom(struct wasapi_capture *wc, size_t sample_rate, uint64_t headroom)
 {
-	size_t total_floats = AUDIO_OUTPUT_FRAMES;
+	uint64_t tick_ns = audio_frames_to_ns(sample_rate, AUDIO_OUTPUT_FRAMES);
+	uint64_t step_ns = audio_frames_to_ns(sample_rate, BUFFERING_DRAIN_STEP_FRAMES);
+
+	if (!wc->total_buffering_ticks || wc->buffering_wait_ticks || headroom == UINT64_MAX)
+		return false;
+
+	if (wc->draining) {
+		if (headroom >= tick_ns + step_ns)
+			return true;
+
+		/* the backlog ran out before a whole tick was drained, try
+		 * again after another quiet period */
+		debug("audio buffering drain stopped, headroom %" PRIu64 " ns", headroom);
+		wc->draining = false;
+		return false;
+	}
+
+	if (headroom < wc->min_headroom)
+		wc->min_headroom = headroom;
+
+	if (++wc->headroom_ticks < BUFFERING_DRAIN_CHECK_TICKS)
+		return false;
+
+	wc->draining = wc->min_headroom >= tick_ns + step_ns;
+	wc->headroom_ticks = 0;
+	wc->min_headroom = UINT64_MAX;
+	return wc->draining;
+}
+
+/* the window has been moved forward by a whole tick, so the oldest queued
+ * timestamp is dropped and the offset starts over */
+static void wasapi_capture_remove_audio_buffering(struct wasapi_capture *wc, size_t sample_rate)
+{
+	size_t drained_ms = AUDIO_OUTPUT_FRAMES * 1000 / sample_rate;
+	size_t total_ms;
+
+	circlebuf_pop_front(&wc->buffered_timestamps, NULL, sizeof(struct ts_info));
+	wc->drain_frames -= AUDIO_OUTPUT_FRAMES;
+	wc->total_buffering_ticks--;
+	wc->draining = false;
+
+	total_ms = wc->total_buffering_ticks * AUDIO_OUTPUT_FRAMES * 1000 / sample_rate;
+	os_atomic_set_long(&wc->stats.drained_ms, os_atomic_load_long(&wc->stats.drained_ms) + (long)drained_ms);
+	update_buffering_stats(wc, sample_rate);
+
+	blog(LOG_INFO,
+	     "wasapi-capture===>: removed %d milliseconds of audio buffering, total "
+	     "audio buffering is now %d milliseconds",
+	     (int)drained_ms, (int)total_ms);
+}
+
+/* adds the part of one plane of a channel that falls into the window to the
+ * mix inputs, viewed in place in the channel's ring */
+static inline void add_mix_input(struct wasapi_capture *wc, struct audio_channel *source, size_t ch, size_t sample_rate, const struct ts_info *ts)
+{
+	struct mix_input *input;
+	struct audio_span span;
 	size_t start_point = 0;
 
 	if (source->audio_ts < ts->start || ts->end <= source->audio_ts)
@@ -160,50 +264,92 @@ static inline void wasapi_capture_mix_audio(struct audio_output_data *mixes, str
 		start_point = convert_time_to_frames(sample_rate, source->audio_ts - ts->start);
 		if (start_point == AUDIO_OUTPUT_FRAMES)
 			return;
-
-		total_floats -= start_point;
 	}
 
-	for (size_t ch = 0; ch < channels; ch++) {
-		register float *mix = mixes->data[ch];
-		register float *aud = source->audio_output_buf[ch];
-		register float *end;
+	audio_channel_peek_span(source, ch, AUDIO_OUTPUT_FRAMES - start_point, &span);
 
-		mix += start_point;
-		end = aud + total_floats;
+	input = da_push_back_new(wc->mix_inputs);
+	input->data[0] = span.data[0];
+	input->data[1] = span.data[1];
+	input->frames[0] = span.frames[0];
+	input->frames[1] = span.frames[1];
+	input->start = start_point;
+}
 
-		while (aud < end)
-			*(mix++) += *(aud++);
-	}
+static inline void add_mix_break(struct wasapi_capture *wc, size_t pos)
+{
+	size_t idx = 0;
+
+	while (idx < wc->mix_breaks.num && wc->mix_breaks.array[idx] < pos)
+		idx++;
+	if (idx < wc->mix_breaks.num && wc->mix_breaks.array[idx] == pos)
+		return;
+
+	da_insert(wc->mix_breaks, idx, &pos);
 }
 
-static void ignore_audio(struct audio_channel *source, size_t channels, size_t sample_rate)
+/* writes one plane of the block in a single pass.  the block is split
+ * wherever an input starts, wraps around or ends, so inside each sub range
+ * every input is one contiguous run and the kernel can sum and clamp
+ * all of them before storing */
+static void wasapi_capture_mix_plane(struct wasapi_capture *wc, float *mix)
 {
-	size_t num_floats = source->audio_input_buf[0].size / sizeof(float);
+	da_resize(wc->mix_breaks, 0);
+	add_mix_break(wc, 0);
+	add_mix_break(wc, AUDIO_OUTPUT_FRAMES);
+
+	for (size_t i = 0; i < wc->mix_inputs.num; i++) {
+		struct mix_input *input = &wc->mix_inputs.array[i];
+		add_mix_break(wc, input->start);
+		add_mix_break(wc, input->start + input->frames[0]);
+		add_mix_break(wc, input->start + input->frames[0] + input->frames[1]);
+	}
+
+	for (size_t b = 0; b + 1 < wc->mix_breaks.num; b++) {
+		size_t begin = wc->mix_breaks.array[b];
+		size_t end = wc->mix_breaks.array[b + 1];
+
+		da_resize(wc->mix_srcs, 0);
 
-	if (num_floats) {
-		for (size_t ch = 0; ch < channels; ch++)
-			circlebuf_pop_front(&source->audio_input_buf[ch], NULL, source->audio_input_buf[ch].size);
+		for (size_t i = 0; i < wc->mix_inputs.num; i++) {
+			struct mix_input *input = &wc->mix_inputs.array[i];
+			size_t seg_begin = input->start;
 
-		source->last_audio_input_buf_size = 0;
-		source->audio_ts += (uint64_t)num_floats * 1000000000ULL / (uint64_t)sample_rate;
+			for (size_t seg = 0; seg < 2; seg++) {
+				size_t seg_end = seg_begin + input->frames[seg];
+
+				if (seg_begin <= begin && end <= seg_end) {
+					const float *src = input->data[seg] + (begin - seg_begin);
+					da_push_back(wc->mix_srcs, &src);
+					break;
+				}
+
+				seg_begin = seg_end;
+			}
+		}
+
+		audio_mix_fused(mix + begin, wc->mix_srcs.array, wc->mix_srcs.num, end - begin);
 	}
 }
 
-static bool discard_if_stopped(struct audio_channel *source, size_t channels)
+static void ignore_audio(struct audio_channel *source, size_t sample_rate)
 {
-	size_t last_size;
-	size_t size;
+	size_t num_floats = audio_channel_frames(source);
 
-	last_size = source->last_audio_input_buf_size;
-	size = source->audio_input_buf[0].size;
+	if (num_floats)
+		audio_channel_consume(source, num_floats, source->audio_ts + (uint64_t)num_floats * 1000000000ULL / (uint64_t)sample_rate);
+}
 
-	if (!size)
+static bool discard_if_stopped(struct audio_channel *source)
+{
+	uint32_t write_pos = source->seen.write_pos;
+
+	if (!audio_channel_frames(source))
 		return false;
 
 	/* if perpetually pending data, it means the audio has stopped,
 	 * so clear the audio data */
-	if (last_size == size) {
+	if (source->last_write_pos == write_pos) {
 		if (!source->pending_stop) {
 			source->pending_stop = true;
 #if DEBUG_AUDIO == 1
@@ -212,30 +358,22 @@ static bool discard_if_stopped(struct audio_channel *source, size_t channels)
 			return true;
 		}
 
-		for (size_t ch = 0; ch < channels; ch++)
-			circlebuf_pop_front(&source->audio_input_buf[ch], NULL, source->audio_input_buf[ch].size);
-
+		audio_channel_clear(source);
 		source->pending_stop = false;
-		source->audio_ts = 0;
-		source->last_audio_input_buf_size = 0;
 #if DEBUG_AUDIO == 1
 		blog(LOG_DEBUG, "source audio data appears to have "
 				"stopped, clearing");
 #endif
 		return true;
 	} else {
-		source->last_audio_input_buf_size = size;
+		source->last_write_pos = write_pos;
 		return false;
 	}
 }
 
-#define MAX_AUDIO_SIZE (AUDIO_OUTPUT_FRAMES * sizeof(float))
-
-static inline void wasapi_capture_discard_audio(struct wasapi_capture *wc, struct audio_channel *source, size_t channels, size_t sample_rate,
-						struct ts_info *ts)
+static inline void wasapi_capture_discard_audio(struct wasapi_capture *wc, struct audio_channel *source, size_t sample_rate, struct ts_info *ts)
 {
 	size_t total_floats = AUDIO_OUTPUT_FRAMES;
-	size_t size;
 
 	if (ts->end <= source->audio_ts) {
 #if DEBUG_AUDIO == 1
@@ -249,7 +387,7 @@ static inline void wasapi_capture_discard_audio(struct wasapi_capture *wc, struc
 	}
 
 	if (source->audio_ts < (ts->start - 1)) {
-		if (source->audio_pending && source->audio_input_buf[0].size < MAX_AUDIO_SIZE && discard_if_stopped(source, channels))
+		if (source->audio_pending && audio_channel_frames(source) < AUDIO_OUTPUT_FRAMES && discard_if_stopped(source))
 			return;
 
 #if DEBUG_AUDIO == 1
@@ -260,7 +398,7 @@ static inline void wasapi_capture_discard_audio(struct wasapi_capture *wc, struc
 		     source->audio_ts, ts->start);
 #endif
 		if (wc->total_buffering_ticks == MAX_BUFFERING_TICKS)
-			ignore_audio(source, channels, sample_rate);
+			ignore_audio(source, sample_rate);
 		return;
 	}
 
@@ -277,10 +415,8 @@ static inline void wasapi_capture_discard_audio(struct wasapi_capture *wc, struc
 		total_floats -= start_point;
 	}
 
-	size = total_floats * sizeof(float);
-
-	if (source->audio_input_buf[0].size < size) {
-		if (discard_if_stopped(source, channels))
+	if (audio_channel_frames(source) < total_floats) {
+		if (discard_if_stopped(source))
 			return;
 
 #if DEBUG_AUDIO == 1
@@ -290,87 +426,116 @@ static inline void wasapi_capture_discard_audio(struct wasapi_capture *wc, struc
 		return;
 	}
 
-	for (size_t ch = 0; ch < channels; ch++)
-		circlebuf_pop_front(&source->audio_input_buf[ch], NULL, size);
-
-	source->last_audio_input_buf_size = 0;
-
 #if DEBUG_AUDIO == 1
 	blog(LOG_DEBUG, "audio discarded, new ts: %" PRIu64, ts->end);
 #endif
 
 	source->pending_stop = false;
-	source->audio_ts = ts->end;
+	audio_channel_consume(source, total_floats, ts->end);
+}
+
+/* the mixer bumps mix_epoch before it picks up the channel list for a tick,
+ * so once the epoch moved past the one seen when a list was replaced, the
+ * mixer is done with the old list and the channels evicted with it */
+static inline struct channel_list *acquire_channel_list(struct wasapi_capture *wc)
+{
+	os_atomic_inc_long(&wc->mix_epoch);
+	return InterlockedCompareExchangePointer((PVOID volatile *)&wc->channel_list, NULL, NULL);
 }
 
 bool wasapi_capture_fetch_audio(struct wasapi_capture *wc, uint64_t start_ts_in, uint64_t end_ts_in, uint64_t *out_ts, struct audio_output_data *mixes)
 {
-	da_resize(wc->mix_channels, 0);
+	size_t sample_rate = wc->out_sample_info.samples_per_sec;
+	struct channel_list *list = acquire_channel_list(wc);
+	uint64_t headroom = UINT64_MAX;
+	uint64_t shift;
 
 	struct ts_info ts;
 	ts.start = start_ts_in;
 	ts.end = end_ts_in;
 	circlebuf_push_back(&wc->buffered_timestamps, &ts, sizeof(ts));
+
+	if (wc->drain_frames >= AUDIO_OUTPUT_FRAMES && wc->buffered_timestamps.size > sizeof(ts))
+		wasapi_capture_remove_audio_buffering(wc, sample_rate);
+
 	circlebuf_peek_front(&wc->buffered_timestamps, &ts, sizeof(ts));
 
-	uint64_t min_ts = ts.start;
+	/* while draining, the window runs ahead of the queued timestamps */
+	shift = audio_frames_to_ns(sample_rate, wc->drain_frames);
+	ts.start += shift;
+	ts.end += shift;
 
-	size_t audio_size = AUDIO_OUTPUT_FRAMES * sizeof(float);
+	uint64_t min_ts = ts.start;
 
 #if DEBUG_AUDIO == 1
 	blog(LOG_DEBUG, "ts %llu-%llu", ts.start, ts.end);
 #endif
 
-	pthread_mutex_lock(&wc->channel_mutex);
-	for (size_t i = 0; i < wc->audio_channels.num; i++) {
-		da_push_back(wc->mix_channels, &(wc->audio_channels.array[i].channel));
-	}
-	pthread_mutex_unlock(&wc->channel_mutex);
 	/* ------------------------------------------------ */
-	/* render audio data */
-	for (size_t i = 0; i < wc->mix_channels.num; i++) {
-		audio_channel_pick_audio_data(wc->mix_channels.array[i], audio_size, wc->channels);
+	/* check which channels can fill a block */
+	for (size_t i = 0; i < list->num; i++) {
+		audio_channel_poll_audio_data(list->array[i], AUDIO_OUTPUT_FRAMES);
 	}
 
 	/* ------------------------------------------------ */
 	/* get minimum audio timestamp */
-	pthread_mutex_lock(&wc->channel_mutex);
-	calc_min_ts(wc, wc->out_sample_info.samples_per_sec, &min_ts);
-	pthread_mutex_unlock(&wc->channel_mutex);
+	calc_min_ts(list, sample_rate, &min_ts);
 
 	/* ------------------------------------------------ */
 	/* if a source has gone backward in time, buffer */
 	if (min_ts < ts.start)
-		wasapi_capture_add_audio_buffering(wc, wc->out_sample_info.samples_per_sec, &ts, min_ts);
+		wasapi_capture_add_audio_buffering(wc, sample_rate, &ts, min_ts);
 
 	/* ------------------------------------------------ */
 	/* mix audio */
 	if (!wc->buffering_wait_ticks) {
-		for (size_t i = 0; i < wc->mix_channels.num; i++) {
-			struct audio_channel *source = wc->mix_channels.array[i];
+		for (size_t ch = 0; ch < wc->channels; ch++) {
+			da_resize(wc->mix_inputs, 0);
 
-			if (source->audio_pending)
-				continue;
+			for (size_t i = 0; i < list->num; i++) {
+				struct audio_channel *source = list->array[i];
+				if (!source->audio_pending && source->audio_ts)
+					add_mix_input(wc, source, ch, sample_rate, &ts);
+			}
 
-			pthread_mutex_lock(&source->audio_buf_mutex);
+			wasapi_capture_mix_plane(wc, mixes->data[ch]);
+		}
+	}
 
-			if (source->audio_output_buf[0][0] && source->audio_ts)
-				wasapi_capture_mix_audio(mixes, source, wc->channels, wc->out_sample_info.samples_per_sec, &ts);
+	/* ------------------------------------------------ */
+	/* measure how far ahead of the window the channels are */
+	for (size_t i = 0; i < list->num; i++) {
+		struct audio_channel *a_c = list->array[i];
+		uint64_t end;
 
-			pthread_mutex_unlock(&source->audio_buf_mutex);
-		}
+		end = audio_channel_buffered_end(a_c, sample_rate);
+
+		if (!end)
+			continue;
+		if (a_c->audio_pending || end <= ts.end)
+			headroom = 0;
+		else if (end - ts.end < headroom)
+			headroom = end - ts.end;
 	}
 
 	/* ------------------------------------------------ */
-	/* discard audio */
-	pthread_mutex_lock(&wc->channel_mutex);
-	for (size_t i = 0; i < wc->audio_channels.num; i++) {
-		struct audio_channel *a_c = wc->audio_channels.array[i].channel;
-		pthread_mutex_lock(&a_c->audio_buf_mutex);
-		wasapi_capture_discard_audio(wc, a_c, wc->channels, wc->out_sample_info.samples_per_sec, &ts);
-		pthread_mutex_unlock(&a_c->audio_buf_mutex);
+	/* discard audio, and if the next window moves forward by a drain
+	 * step, the frames it jumps over along with it */
+	bool drain = check_buffering_headroom(wc, sample_rate, headroom);
+	uint64_t next_start = ts.end;
+
+	if (drain) {
+		wc->drain_frames += BUFFERING_DRAIN_STEP_FRAMES;
+		next_start = ts.end - shift + audio_frames_to_ns(sample_rate, wc->drain_frames);
+		update_buffering_stats(wc, sample_rate);
+	}
+
+	for (size_t i = 0; i < list->num; i++) {
+		struct audio_channel *a_c = list->array[i];
+		wasapi_capture_discard_audio(wc, a_c, sample_rate, &ts);
+		if (drain && a_c->audio_ts == ts.end)
+			audio_channel_skip_to(a_c, sample_rate, next_start, BUFFERING_DRAIN_FADE_FRAMES);
 	}
-	pthread_mutex_unlock(&wc->channel_mutex);
 
 	circlebuf_pop_front(&wc->buffered_timestamps, NULL, sizeof(ts));
 
@@ -384,26 +549,35 @@ bool wasapi_capture_fetch_audio(struct wasapi_capture *wc, uint64_t start_ts_in,
 	return true;
 }
 
-static inline void clamp_audio_output(struct wasapi_capture *wc, size_t bytes)
+/* the direct path fed obs up to the present, so the mixer starts over
+ * without the buffering it had built up */
+static void reset_audio_buffering(struct wasapi_capture *wc, size_t sample_rate)
 {
-	size_t float_size = bytes / sizeof(float);
+	circlebuf_pop_front(&wc->buffered_timestamps, NULL, wc->buffered_timestamps.size);
+	wc->buffered_ts = 0;
+	wc->buffering_wait_ticks = 0;
+	wc->total_buffering_ticks = 0;
+	wc->drain_frames = 0;
+	wc->draining = false;
+	wc->headroom_ticks = 0;
+	wc->min_headroom = UINT64_MAX;
+	update_buffering_stats(wc, sample_rate);
+}
 
-	for (size_t plane = 0; plane < wc->planes; plane++) {
-		float *mix_data = wc->buffer[plane];
-		float *mix_end = &mix_data[float_size];
+/* whatever was queued before the channel went direct is stale by the time
+ * it goes back through the ring */
+static void clear_mix_channels(struct wasapi_capture *wc)
+{
+	struct channel_list *list = acquire_channel_list(wc);
 
-		while (mix_data < mix_end) {
-			float val = *mix_data;
-			val = (val > 1.0f) ? 1.0f : val;
-			val = (val < -1.0f) ? -1.0f : val;
-			*(mix_data++) = val;
-		}
+	for (size_t i = 0; i < list->num; i++) {
+		audio_channel_poll_audio_data(list->array[i], AUDIO_OUTPUT_FRAMES);
+		audio_channel_clear(list->array[i]);
 	}
 }
 
 static void wasapi_capture_input_and_output(struct wasapi_capture *wc, uint64_t audio_time, uint64_t prev_time)
 {
-	size_t bytes = AUDIO_OUTPUT_FRAMES * wc->block_size;
 	struct audio_output_data data;
 	uint64_t new_ts = 0;
 	bool success;
@@ -411,23 +585,18 @@ static void wasapi_capture_input_and_output(struct wasapi_capture *wc, uint64_t
 	memset(&data, 0, sizeof(struct audio_output_data));
 
 #if DEBUG_AUDIO == 1
-	blog(LOG_DEBUG, "audio_time: %llu, prev_time: %llu, bytes: %lu", audio_time, prev_time, bytes);
+	blog(LOG_DEBUG, "audio_time: %llu, prev_time: %llu, bytes: %lu", audio_time, prev_time, AUDIO_OUTPUT_FRAMES * wc->block_size);
 #endif
 
-	/* clear mix buffers */
-	memset(wc->buffer[0], 0, AUDIO_OUTPUT_FRAMES * MAX_AUDIO_CHANNELS * sizeof(float));
-
 	for (size_t i = 0; i < wc->planes; i++)
 		data.data[i] = wc->buffer[i];
 
-	/* get new audio data */
+	/* get new audio data, every plane is mixed and clamped in
+	 * one pass straight into wc->buffer */
 	success = wasapi_capture_fetch_audio(wc, prev_time, audio_time, &new_ts, &data);
 	if (!success)
 		return;
 
-	///* clamps audio data to -1.0..1.0 */
-	clamp_audio_output(wc, bytes);
-
 	struct obs_source_audio audio;
 	audio.format = AUDIO_FORMAT_FLOAT_PLANAR;
 	audio.frames = AUDIO_OUTPUT_FRAMES;
@@ -440,56 +609,320 @@ static void wasapi_capture_input_and_output(struct wasapi_capture *wc, uint64_t
 	obs_source_output_audio(wc->source, &audio);
 }
 
+static inline void update_mix_stats(struct wasapi_capture *wc, const struct mix_scheduler_stats *stats)
+{
+	os_atomic_set_long(&wc->stats.late_ticks, (long)stats->late_ticks);
+	os_atomic_set_long(&wc->stats.max_lateness_us, (long)(stats->max_lateness / 1000));
+	os_atomic_set_long(&wc->stats.catch_up_ticks, (long)stats->catch_up_ticks);
+	os_atomic_set_long(&wc->stats.max_burst, (long)stats->max_burst);
+	os_atomic_set_long(&wc->stats.early_ticks, (long)stats->early_ticks);
+}
+
+static bool mix_input_ready(struct wasapi_capture *wc)
+{
+	struct channel_list *list = acquire_channel_list(wc);
+
+	if (!list->num)
+		return false;
+
+	for (size_t i = 0; i < list->num; i++) {
+		if (!audio_channel_ready(list->array[i], AUDIO_OUTPUT_FRAMES))
+			return false;
+	}
+
+	return true;
+}
+
+/* the event only says that something arrived, readiness is checked against
+ * the channels themselves */
+static bool wait_mix_input(void *param, uint64_t deadline)
+{
+	struct wasapi_capture *wc = param;
+
+	while (!mix_input_ready(wc)) {
+		uint64_t now = os_gettime_ns();
+		if (!wc->capturing || now >= deadline)
+			return false;
+
+		WaitForSingleObject(wc->mix_ready_event, (DWORD)((deadline - now + 999999) / 1000000));
+	}
+
+	return true;
+}
+
+static uint64_t os_clock_now(void *param)
+{
+	UNUSED_PARAMETER(param);
+	return os_gettime_ns();
+}
+
+static void os_clock_sleep_until(void *param, uint64_t deadline)
+{
+	UNUSED_PARAMETER(param);
+	os_sleepto_ns(deadline);
+}
+
 static void mix_thread_proc(LPVOID param)
 {
 	os_set_thread_name("wasapi-capture: audio mix thread");
 
 	struct wasapi_capture *wc = param;
-	size_t rate = wc->out_sample_info.samples_per_sec;
-	uint64_t samples = 0;
-	uint64_t start_time = os_gettime_ns();
-	uint64_t prev_time = start_time;
-	uint64_t audio_time = prev_time;
-	uint32_t audio_wait_time = (uint32_t)(audio_frames_to_ns(rate, AUDIO_OUTPUT_FRAMES) / 1000000);
+	struct mix_scheduler sched;
+	struct mix_clock clock = {os_clock_now, os_clock_sleep_until, NULL};
+
+	mix_scheduler_init(&sched, &clock, wc->out_sample_info.samples_per_sec, AUDIO_OUTPUT_FRAMES);
+
+	uint64_t prev_time = sched.start_time;
+	bool direct = false;
 
 	while (wc->capturing) {
-		os_sleep_ms(audio_wait_time);
+		size_t due = os_atomic_load_bool(&wc->low_latency) ? mix_scheduler_wait_ready(&sched, wait_mix_input, wc)
+								     : mix_scheduler_wait(&sched);
+
+		/* the timeline keeps running while the capture thread outputs a
+		 * single channel directly, only the mixing is skipped */
+		if (os_atomic_load_bool(&wc->direct_output) != direct) {
+			direct = !direct;
+			if (direct)
+				clear_mix_channels(wc);
+			else
+				reset_audio_buffering(wc, sched.sample_rate);
+		}
 
-		uint64_t cur_time = os_gettime_ns();
-		while (audio_time <= cur_time) {
-			samples += AUDIO_OUTPUT_FRAMES;
-			audio_time = start_time + audio_frames_to_ns(rate, samples);
+		for (size_t i = 0; i < due; i++) {
+			uint64_t audio_time = mix_scheduler_advance(&sched);
 
-			wasapi_capture_input_and_output(wc, audio_time, prev_time);
+			/* acquiring the list still moves the epoch on, so
+			 * retired lists are freed while the mixer idles */
+			if (!direct)
+				wasapi_capture_input_and_output(wc, audio_time, prev_time);
+			else
+				acquire_channel_list(wc);
 
 			prev_time = audio_time;
 		}
+
+		update_mix_stats(wc, &sched.stats);
 	}
 }
 
-static void output_audio_data(struct wasapi_capture *wc, struct obs_source_audio *data, uint64_t ptr)
+static inline void lock_channels(struct wasapi_capture *wc)
 {
-	struct audio_channel *channel = NULL;
-	pthread_mutex_lock(&wc->channel_mutex);
-	for (size_t i = 0; i < wc->audio_channels.num; i++) {
-		if (wc->audio_channels.array[i].ptr == ptr) {
-			channel = wc->audio_channels.array[i].channel;
-			break;
+	if (pthread_mutex_trylock(&wc->channel_mutex) != 0) {
+		os_atomic_inc_long(&wc->stats.channel_lock_contention);
+		pthread_mutex_lock(&wc->channel_mutex);
+	}
+}
+
+/* a lone channel bypasses the mixer, as soon as a second one shows up both go
+ * through the ring again.  capture thread only */
+static void update_direct_output(struct wasapi_capture *wc)
+{
+	struct audio_channel *direct = wc->audio_channels.num == 1 ? wc->audio_channels.array[0].channel : NULL;
+
+	if (direct == wc->direct_channel)
+		return;
+
+	if (wc->direct_channel)
+		audio_channel_set_direct_output(wc->direct_channel, NULL);
+	if (direct)
+		audio_channel_set_direct_output(direct, wc->source);
+
+	wc->direct_channel = direct;
+	os_atomic_set_bool(&wc->direct_output, direct != NULL);
+}
+
+/* swaps in a copy of audio_channels for the mixer and returns the mix epoch
+ * the old copy has to outlive */
+static long publish_channel_list(struct wasapi_capture *wc)
+{
+	size_t num = wc->audio_channels.num;
+	struct channel_list *list = bmalloc(sizeof(*list) + num * sizeof(list->array[0]));
+	struct retired_item item = {0};
+
+	list->num = num;
+	for (size_t i = 0; i < num; i++)
+		list->array[i] = wc->audio_channels.array[i].channel;
+
+	item.list = InterlockedExchangePointer((PVOID volatile *)&wc->channel_list, list);
+	item.epoch = os_atomic_load_long(&wc->mix_epoch);
+	da_push_back(wc->retired, &item);
+
+	os_atomic_set_long(&wc->stats.live_channels, (long)num);
+	update_direct_output(wc);
+	return item.epoch;
+}
+
+/* frees old channel lists and pools evicted channels once the mixer has
+ * started a tick after they were replaced; with all set the mixer must not
+ * be running */
+static void reclaim_retired(struct wasapi_capture *wc, bool all)
+{
+	long epoch = os_atomic_load_long(&wc->mix_epoch);
+	size_t i = 0;
+
+	while (i < wc->retired.num) {
+		struct retired_item item = wc->retired.array[i];
+
+		if (!all && item.epoch == epoch) {
+			i++;
+			continue;
 		}
+
+		bfree(item.list);
+		if (item.channel) {
+			if (wc->channel_pool.num < CHANNEL_POOL_SIZE)
+				da_push_back(wc->channel_pool, &item.channel);
+			else
+				audio_channel_destroy(item.channel);
+		}
+
+		da_erase(wc->retired, i);
 	}
+}
+
+/* only called from the capture thread, which owns channel_map, so the
+ * lookup needs no lock */
+static struct audio_channel *get_audio_channel(struct wasapi_capture *wc, uint64_t ptr)
+{
+	struct audio_channel *channel = channel_map_find(&wc->channel_map, ptr);
+	struct audio_channel_info info;
+
+	if (channel)
+		return channel;
+
+	lock_channels(wc);
+	if (wc->channel_pool.num) {
+		channel = da_end(wc->channel_pool);
+		da_pop_back(wc->channel_pool);
+		audio_channel_reset(channel, &wc->jitter_params);
+	} else {
+		channel = audio_channel_create(&wc->out_sample_info, &wc->jitter_params, &wc->resamplers);
+	}
+	channel->last_input_time = os_gettime_ns();
+	info.channel = channel;
+	info.ptr = ptr;
+	da_push_back(wc->audio_channels, &info);
 	pthread_mutex_unlock(&wc->channel_mutex);
 
-	if (!channel) {
-		channel = audio_channel_create(&wc->out_sample_info);
-		struct audio_channel_info info;
-		info.channel = channel;
-		info.ptr = ptr;
-		pthread_mutex_lock(&wc->channel_mutex);
-		da_push_back(wc->audio_channels, &info);
-		pthread_mutex_unlock(&wc->channel_mutex);
+	publish_channel_list(wc);
+	channel_map_insert(&wc->channel_map, ptr, channel);
+	return channel;
+}
+
+/* drops channels that have not had a packet for the configured timeout,
+ * they are recycled once the mixer is done with the list they were in.
+ * silent streams send heartbeat packets, so this only catches streams the
+ * target stopped rendering altogether */
+static void evict_idle_channels(struct wasapi_capture *wc, uint64_t now)
+{
+	uint64_t timeout = (uint64_t)os_atomic_load_long(&wc->channel_timeout) * 1000000000ULL;
+	DARRAY(struct audio_channel *) evicted;
+	size_t i = 0;
+	long epoch;
+
+	da_init(evicted);
+
+	lock_channels(wc);
+	while (i < wc->audio_channels.num) {
+		struct audio_channel_info info = wc->audio_channels.array[i];
+
+		if (now - info.channel->last_input_time < timeout) {
+			i++;
+			continue;
+		}
+
+		channel_map_remove(&wc->channel_map, info.ptr);
+		for (size_t s = 0; s < AUDIO_MAX_STREAMS; s++) {
+			if (wc->streams[s].channel == info.channel)
+				memset(&wc->streams[s], 0, sizeof(wc->streams[s]));
+		}
+
+		audio_channel_release_resampler(info.channel);
+		da_erase(wc->audio_channels, i);
+		da_push_back(evicted, &info.channel);
+		debug("evicted idle audio channel 0x%p", info.channel);
+	}
+	pthread_mutex_unlock(&wc->channel_mutex);
+
+	if (evicted.num) {
+		epoch = publish_channel_list(wc);
+
+		for (i = 0; i < evicted.num; i++) {
+			struct retired_item item = {epoch, NULL, evicted.array[i]};
+			da_push_back(wc->retired, &item);
+		}
+
+		os_atomic_set_long(&wc->stats.evicted_channels, os_atomic_load_long(&wc->stats.evicted_channels) + (long)evicted.num);
+	}
+
+	da_free(evicted);
+	reclaim_retired(wc, false);
+}
+
+/* reports the drift of the channel furthest off the obs clock */
+static void update_drift_stats(struct wasapi_capture *wc)
+{
+	double drift = 0.0;
+
+	for (size_t i = 0; i < wc->audio_channels.num; i++) {
+		double ppm = wc->audio_channels.array[i].channel->drift.integral;
+		if (fabs(ppm) > fabs(drift))
+			drift = ppm;
+	}
+
+	os_atomic_set_long(&wc->stats.drift_ppm, (long)drift);
+}
+
+/* the hook's publisher thread refreshes these about once a second */
+static void update_hook_stats(struct wasapi_capture *wc)
+{
+	const struct audio_hook_stats *shared = &wc->shmem_data->hook_stats;
+	struct audio_hook_stats hook;
+	int attempt = 0;
+
+	/* read under the hook's sequence counter; if the hook is stuck
+	 * mid-update keep the previous values until the next second */
+	for (;;) {
+		uint32_t seq = audio_ring_load_acquire(&shared->seq);
+		hook = *shared;
+		audio_ring_fence_acquire();
+
+		if (!(seq & 1) && audio_ring_load_acquire(&shared->seq) == seq)
+			break;
+		if (++attempt == 64)
+			return;
 	}
 
-	audio_channel_output_audio(channel, data);
+	os_atomic_set_long(&wc->stats.hook_avg_ns, hook.calls ? (long)(hook.total_ns / hook.calls) : 0);
+	os_atomic_set_long(&wc->stats.hook_max_ns, (long)hook.max_ns);
+	os_atomic_set_long(&wc->stats.hook_dropped, (long)hook.dropped);
+}
+
+/* the stream table entry only has to be read again when the hook registered
+ * a new stream in the slot or the format changed, every other packet is a
+ * plain index */
+static struct stream_info *get_stream(struct wasapi_capture *wc, const struct audio_packet_header *header)
+{
+	struct stream_info *stream = &wc->streams[header->stream_index];
+	struct audio_stream_desc desc;
+
+	if (stream->desc.generation == header->generation)
+		return stream;
+
+	/* a newer generation means the packet was written with a format that
+	 * is gone already, drop it */
+	if (!audio_stream_desc_read(&wc->shmem_data->streams[header->stream_index], header->generation, &desc))
+		return NULL;
+
+	if (!desc.channels || !desc.byte_per_sample)
+		return NULL;
+
+	if (!stream->channel || stream->desc.client != desc.client)
+		stream->channel = get_audio_channel(wc, desc.client);
+
+	stream->desc = desc;
+	return stream;
 }
 
 static void capture_thread_proc(LPVOID param)
@@ -498,54 +931,74 @@ static void capture_thread_proc(LPVOID param)
 	struct wasapi_capture *wc = param;
 	while (wc->capturing) {
 		if (WaitForSingleObject(wc->audio_data_event, 100) == WAIT_OBJECT_0) {
-			if (!wc->capturing)
-				break;
-
-			if (WaitForSingleObject(wc->audio_data_mutex, 10) == WAIT_OBJECT_0) {
-				uint32_t audio_size = wc->shmem_data->available_audio_size;
-				if (audio_size > 0) {
-					uint32_t offset = 0;
-					while (true) {
-						if (offset >= audio_size)
-							break;
-
-						uint8_t *buffer_data = wc->audio_data_buffer + offset + 4;
-
-						uint32_t nf = 0;
-						memcpy(&nf, wc->audio_data_buffer + offset, 4);
-						offset += nf;
-
-						uint64_t ptr = 0;
-						uint64_t timestamp = 0;
-						uint32_t channel = 0, samplerate = 0, format = 0, byte_per_sample = 0;
-						memcpy(&ptr, buffer_data, 8);
-						memcpy(&channel, buffer_data + 8, 4);
-						memcpy(&samplerate, buffer_data + 12, 4);
-						memcpy(&format, buffer_data + 16, 4);
-						memcpy(&byte_per_sample, buffer_data + 20, 4);
-						memcpy(&timestamp, buffer_data + 24, 8);
-
-						struct obs_source_audio data = {0};
-						data.data[0] = (const uint8_t *)(buffer_data + 32);
-						data.frames = (uint32_t)((nf - 36) / (channel * byte_per_sample));
-						data.speakers = (enum speaker_layout)channel;
-						data.samples_per_sec = samplerate;
-						data.format = format;
-						data.timestamp = timestamp;
-						output_audio_data(wc, &data, ptr);
-
-						wc->shmem_data->available_audio_size -= nf;
-					}
+			const struct audio_packet_header *header;
+			uint64_t now = os_gettime_ns();
+			uint32_t size;
+
+			while (wc->capturing && (header = audio_ring_peek(&wc->audio_ring, &size)) != NULL) {
+				struct stream_info *stream = NULL;
+
+				if (audio_packet_valid(header, size) && (header->flags & AUDIO_PACKET_SILENT)) {
+					/* a heartbeat only counts for a stream that
+					 * already has a channel, it never creates one */
+					struct stream_info *silent = &wc->streams[header->stream_index];
+					if (silent->channel && silent->desc.generation == header->generation)
+						silent->channel->last_input_time = now;
+
+				} else if (audio_packet_valid(header, size) && header->frames) {
+					stream = get_stream(wc, header);
+				}
+
+				if (stream && header->data_size >= header->frames * stream->desc.channels * stream->desc.byte_per_sample) {
+					struct obs_source_audio data = {0};
+					data.data[0] = audio_packet_data(header);
+					data.frames = header->frames;
+					data.speakers = (enum speaker_layout)stream->desc.channels;
+					data.samples_per_sec = stream->desc.samplerate;
+					data.format = (enum audio_format)stream->desc.format;
+					data.timestamp = header->timestamp;
+					stream->channel->last_input_time = now;
+
+					/* packets from hooks without a frame counter
+					 * go through the timestamp heuristics */
+					if (audio_packet_has_field(header, frame_index))
+						audio_channel_output_audio(stream->channel, &data, header->frame_index,
+									   !!(header->flags & AUDIO_PACKET_DISCONTINUITY));
+					else
+						audio_channel_output_audio(stream->channel, &data, 0, true);
 				}
-				ReleaseMutex(wc->audio_data_mutex);
+
+				audio_ring_release(&wc->audio_ring);
 			}
+
+			if (os_atomic_load_bool(&wc->low_latency) && !wc->direct_channel)
+				SetEvent(wc->mix_ready_event);
+		}
+
+		uint64_t now = os_gettime_ns();
+		if (now - wc->last_evict_check >= CHANNEL_EVICT_INTERVAL) {
+			evict_idle_channels(wc, now);
+			update_drift_stats(wc);
+			update_hook_stats(wc);
+			wc->last_evict_check = now;
 		}
 	}
 }
 
 static inline bool init_shmem_capture(struct wasapi_capture *wc)
 {
+	if (!audio_ring_capacity_valid(wc->shmem_data->buffer_size) || wc->shmem_data->audio_offset < sizeof(struct shmem_data) ||
+	    wc->shmem_data->audio_offset + wc->shmem_data->buffer_size > wc->global_hook_info->map_size) {
+		warn("init_shmem_capture: invalid audio ring (offset %u, size %u)", wc->shmem_data->audio_offset,
+		     wc->shmem_data->buffer_size);
+		return false;
+	}
+
 	wc->audio_data_buffer = (uint8_t *)wc->data + wc->shmem_data->audio_offset;
+	audio_ring_attach(&wc->audio_ring, &wc->shmem_data->ring, wc->audio_data_buffer, wc->shmem_data->buffer_size);
+
+	/* stream slots are numbered per mapping, channels are kept by client */
+	memset(wc->streams, 0, sizeof(wc->streams));
 	return true;
 }
 
@@ -571,6 +1024,7 @@ static void stop_capture(struct wasapi_capture *wc)
 
 	wc->capturing = false;
 	SetEvent(wc->audio_data_event);
+	SetEvent(wc->mix_ready_event);
 	if (wc->capture_thread != INVALID_HANDLE_VALUE) {
 		WaitForSingleObject(wc->capture_thread, INFINITE);
 		wc->capture_thread = INVALID_HANDLE_VALUE;
@@ -580,6 +1034,9 @@ static void stop_capture(struct wasapi_capture *wc)
 		wc->mix_thread = INVALID_HANDLE_VALUE;
 	}
 
+	/* neither thread is running, nothing can hold on to old lists */
+	reclaim_retired(wc, true);
+
 	if (wc->hook_stop) {
 		info("set hook stop event");
 		SetEvent(wc->hook_stop);
@@ -607,7 +1064,6 @@ static void stop_capture(struct wasapi_capture *wc)
 	close_handle(&wc->keepalive_mutex);
 	close_handle(&wc->global_hook_info_map);
 	close_handle(&wc->target_process);
-	close_handle(&wc->audio_data_mutex);
 	close_handle(&wc->audio_data_event);
 
 	if (wc->active)
@@ -626,6 +1082,27 @@ static const char *wasapi_capture_name(void *unused)
 	return "windows wasapi capture";
 }
 
+static void wasapi_capture_get_stats(void *data, calldata_t *cd)
+{
+	struct wasapi_capture *wc = data;
+
+	calldata_set_int(cd, "buffering_ms", os_atomic_load_long(&wc->stats.buffering_ms));
+	calldata_set_int(cd, "drained_ms", os_atomic_load_long(&wc->stats.drained_ms));
+	calldata_set_int(cd, "live_channels", os_atomic_load_long(&wc->stats.live_channels));
+	calldata_set_int(cd, "evicted_channels", os_atomic_load_long(&wc->stats.evicted_channels));
+	calldata_set_int(cd, "channel_lock_contention", os_atomic_load_long(&wc->stats.channel_lock_contention));
+	calldata_set_int(cd, "late_ticks", os_atomic_load_long(&wc->stats.late_ticks));
+	calldata_set_int(cd, "max_lateness_us", os_atomic_load_long(&wc->stats.max_lateness_us));
+	calldata_set_int(cd, "catch_up_ticks", os_atomic_load_long(&wc->stats.catch_up_ticks));
+	calldata_set_int(cd, "max_burst", os_atomic_load_long(&wc->stats.max_burst));
+	calldata_set_int(cd, "early_ticks", os_atomic_load_long(&wc->stats.early_ticks));
+	calldata_set_int(cd, "arena_allocations", channel_arena_allocations());
+	calldata_set_int(cd, "drift_ppm", os_atomic_load_long(&wc->stats.drift_ppm));
+	calldata_set_int(cd, "hook_avg_ns", os_atomic_load_long(&wc->stats.hook_avg_ns));
+	calldata_set_int(cd, "hook_max_ns", os_atomic_load_long(&wc->stats.hook_max_ns));
+	calldata_set_int(cd, "hook_dropped", os_atomic_load_long(&wc->stats.hook_dropped));
+}
+
 extern void wait_for_hook_initialization(void);
 static void wasapi_capture_update(void *data, obs_data_t *settings);
 static void *wasapi_capture_create(obs_data_t *settings, obs_source_t *source)
@@ -637,9 +1114,14 @@ static void *wasapi_capture_create(obs_data_t *settings, obs_source_t *source)
 	wc->initial_config = true;
 	wc->retry_interval = DEFAULT_RETRY_INTERVAL;
 	wc->capture_thread = INVALID_HANDLE_VALUE;
+	wc->min_headroom = UINT64_MAX;
 	pthread_mutex_init_value(&wc->channel_mutex);
 	pthread_mutex_init(&wc->channel_mutex, NULL);
 	da_init(wc->audio_channels);
+	channel_map_init(&wc->channel_map);
+	resampler_pool_init(&wc->resamplers);
+	wc->channel_list = bzalloc(sizeof(struct channel_list));
+	wc->mix_ready_event = CreateEvent(NULL, false, false, NULL);
 
 	struct obs_audio_info audio_info;
 	obs_get_audio_info(&audio_info);
@@ -652,6 +1134,16 @@ static void *wasapi_capture_create(obs_data_t *settings, obs_source_t *source)
 	wc->planes = planar ? wc->channels : 1;
 	wc->block_size = (planar ? 1 : wc->channels) * get_audio_bytes_per_channel(wc->out_sample_info.format);
 
+	channel_arena_init(&wc->mix_arena, wc->planes * channel_arena_block_size(AUDIO_OUTPUT_FRAMES * sizeof(float)));
+	for (size_t i = 0; i < wc->planes; i++)
+		wc->buffer[i] = channel_arena_alloc(&wc->mix_arena, AUDIO_OUTPUT_FRAMES * sizeof(float));
+
+	proc_handler_t *ph = obs_source_get_proc_handler(source);
+	proc_handler_add(ph, "void get_stats(out int buffering_ms, out int drained_ms, out int live_channels, out int evicted_channels, "
+			     "out int channel_lock_contention, out int late_ticks, out int max_lateness_us, out int catch_up_ticks, "
+			     "out int max_burst, out int early_ticks, out int arena_allocations, out int drift_ppm, "
+			     "out int hook_avg_ns, out int hook_max_ns, out int hook_dropped)", wasapi_capture_get_stats, wc);
+
 	wasapi_capture_update(wc, settings);
 	return wc;
 }
@@ -666,16 +1158,36 @@ static void wasapi_capture_destroy(void *data)
 	for (size_t i = 0; i < wc->audio_channels.num; i++) {
 		audio_channel_destroy(wc->audio_channels.array[i].channel);
 	}
+	reclaim_retired(wc, true);
+	for (size_t i = 0; i < wc->channel_pool.num; i++)
+		audio_channel_destroy(wc->channel_pool.array[i]);
+	bfree(wc->channel_list);
 	da_free(wc->audio_channels);
+	da_free(wc->retired);
+	da_free(wc->channel_pool);
+	channel_map_free(&wc->channel_map);
+	resampler_pool_free(&wc->resamplers);
 
 	pthread_mutex_destroy(&wc->channel_mutex);
 	circlebuf_free(&wc->buffered_timestamps);
-	da_free(wc->mix_channels);
+	CloseHandle(wc->mix_ready_event);
+	channel_arena_free(&wc->mix_arena);
+	da_free(wc->mix_inputs);
+	da_free(wc->mix_breaks);
+	da_free(wc->mix_srcs);
 
 	bfree(wc);
 }
 
-static void wasapi_capture_defaults(obs_data_t *settings) {}
+static void wasapi_capture_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_int(settings, SETTING_JITTER_MIN, DEFAULT_JITTER_MIN);
+	obs_data_set_default_int(settings, SETTING_JITTER_MAX, DEFAULT_JITTER_MAX);
+	obs_data_set_default_int(settings, SETTING_JITTER_PERCENTILE, DEFAULT_JITTER_PERCENTILE);
+	obs_data_set_default_int(settings, SETTING_JITTER_MARGIN, DEFAULT_JITTER_MARGIN);
+	obs_data_set_default_int(settings, SETTING_CHANNEL_TIMEOUT, DEFAULT_CHANNEL_TIMEOUT);
+	obs_data_set_default_bool(settings, SETTING_LOW_LATENCY, false);
+}
 
 static bool window_changed_callback(obs_properties_t *ppts, obs_property_t *p, obs_data_t *settings)
 {
@@ -721,10 +1233,36 @@ static obs_properties_t *wasapi_capture_properties(void *data)
 
 	obs_property_set_modified_callback(p, window_changed_callback);
 
+	obs_properties_add_int_slider(ppts, SETTING_JITTER_MIN, "Minimum jitter buffer (ms)", 0, 500, 1);
+	obs_properties_add_int_slider(ppts, SETTING_JITTER_MAX, "Maximum jitter buffer (ms)", 0, 500, 1);
+	obs_properties_add_int_slider(ppts, SETTING_JITTER_PERCENTILE, "Jitter buffer percentile", 50, 100, 1);
+	obs_properties_add_int_slider(ppts, SETTING_JITTER_MARGIN, "Jitter buffer margin (ms)", 0, 100, 1);
+	obs_properties_add_int_slider(ppts, SETTING_CHANNEL_TIMEOUT, "Idle stream timeout (s)", 1, 300, 1);
+	obs_properties_add_bool(ppts, SETTING_LOW_LATENCY, "Low latency mixing");
+
 	UNUSED_PARAMETER(data);
 	return ppts;
 }
 
+static void update_jitter_params(struct wasapi_capture *wc, obs_data_t *settings)
+{
+	uint64_t min_ms = (uint64_t)obs_data_get_int(settings, SETTING_JITTER_MIN);
+	uint64_t max_ms = (uint64_t)obs_data_get_int(settings, SETTING_JITTER_MAX);
+
+	if (max_ms < min_ms)
+		max_ms = min_ms;
+
+	lock_channels(wc);
+	wc->jitter_params.min_delay = min_ms * 1000000ULL;
+	wc->jitter_params.max_delay = max_ms * 1000000ULL;
+	wc->jitter_params.margin = (uint64_t)obs_data_get_int(settings, SETTING_JITTER_MARGIN) * 1000000ULL;
+	wc->jitter_params.percentile = (uint32_t)obs_data_get_int(settings, SETTING_JITTER_PERCENTILE);
+
+	for (size_t i = 0; i < wc->audio_channels.num; i++)
+		audio_channel_set_jitter_params(wc->audio_channels.array[i].channel, &wc->jitter_params);
+	pthread_mutex_unlock(&wc->channel_mutex);
+}
+
 static void wasapi_capture_update(void *data, obs_data_t *settings)
 {
 	struct wasapi_capture *wc = data;
@@ -743,6 +1281,10 @@ static void wasapi_capture_update(void *data, obs_data_t *settings)
 
 	dstr_copy(&wc->executable, process);
 
+	update_jitter_params(wc, settings);
+	os_atomic_set_long(&wc->channel_timeout, (long)obs_data_get_int(settings, SETTING_CHANNEL_TIMEOUT));
+	os_atomic_set_bool(&wc->low_latency, obs_data_get_bool(settings, SETTING_LOW_LATENCY));
+
 	if (!wc->initial_config) {
 		if (reset_capture) {
 			stop_capture(wc);
@@ -858,23 +1400,8 @@ cleanup:
 	return success;
 }
 
-static inline bool init_audio_data_mutexes(struct wasapi_capture *wc)
+static inline bool init_audio_data_event(struct wasapi_capture *wc)
 {
-	wc->audio_data_mutex = open_mutex_gc(wc, AUDIO_DATA_MUTEX);
-
-	if (!wc->audio_data_mutex) {
-		DWORD error = GetLastError();
-		if (error == 2) {
-			if (!wc->retrying) {
-				wc->retrying = 2;
-				info("hook not loaded yet, retrying..");
-			}
-		} else {
-			warn("failed to open audio data mutexes: %lu", GetLastError());
-		}
-		return false;
-	}
-
 	wc->audio_data_event = open_event_gc(wc, AUDIO_DATA_EVENT);
 
 	if (!wc->audio_data_event) {
@@ -975,8 +1502,8 @@ static bool init_hook(struct wasapi_capture *wc)
 			return false;
 		}
 	}
-	if (!init_audio_data_mutexes(wc)) {
-		info("init audio datex mutex failed");
+	if (!init_audio_data_event(wc)) {
+		info("init audio data event failed");
 		return false;
 	}
 	if (!init_hook_info(wc)) {
@@ -4,6 +4,8 @@
 #include <util/dstr.h>
 #include "wasapi-hook-info.h"
 #include "audio-channel.h"
+#include "channel-map.h"
+#include "channel-arena.h"
 
 #define do_log(level, format, ...) blog(level, "[wasapi-capture: '%s'] " format, obs_source_get_name(wc->source), ##__VA_ARGS__)
 
@@ -21,6 +23,55 @@ struct audio_channel_info {
 	struct audio_channel *channel;
 };
 
+/* plugin side copy of a shmem_data::streams entry and the channel it feeds,
+ * only touched by the capture thread */
+struct stream_info {
+	struct audio_stream_desc desc;
+	struct audio_channel *channel;
+};
+
+/* the part of one plane of a channel that lands in the current mix block,
+ * starting start frames into it as up to two contiguous runs */
+struct mix_input {
+	const float *data[2];
+	size_t frames[2];
+	size_t start;
+};
+
+/* immutable copy of the channel list the mixer walks, replaced as a whole
+ * by the capture thread whenever a channel is added or evicted */
+struct channel_list {
+	size_t num;
+	struct audio_channel *array[];
+};
+
+/* a replaced channel list, or a channel evicted with it, that the mixer may
+ * still be using until mix_epoch moves past epoch */
+struct retired_item {
+	long epoch;
+	struct channel_list *list;
+	struct audio_channel *channel;
+};
+
+/* counters reported by the get_stats procedure, written by the capture and
+ * mix threads with os_atomic_* and read from any thread */
+struct wasapi_capture_stats {
+	volatile long buffering_ms;
+	volatile long drained_ms;
+	volatile long live_channels;
+	volatile long evicted_channels;
+	volatile long channel_lock_contention;
+	volatile long late_ticks;
+	volatile long max_lateness_us;
+	volatile long catch_up_ticks;
+	volatile long max_burst;
+	volatile long early_ticks;
+	volatile long drift_ppm;
+	volatile long hook_avg_ns;
+	volatile long hook_max_ns;
+	volatile long hook_dropped;
+};
+
 struct wasapi_capture {
 	obs_source_t *source;
 
@@ -53,7 +104,6 @@ struct wasapi_capture {
 	HANDLE hook_data_map;
 	HANDLE global_hook_info_map;
 	HANDLE target_process;
-	HANDLE audio_data_mutex;
 	HANDLE audio_data_event;
 	wchar_t *app_sid;
 	int retrying;
@@ -66,23 +116,61 @@ struct wasapi_capture {
 
 		void *data;
 	};
+	struct audio_ring audio_ring;
+	struct stream_info streams[AUDIO_MAX_STREAMS];
 
 	HANDLE capture_thread;
 	HANDLE mix_thread;
 	struct resample_info out_sample_info;
+	struct jitter_params jitter_params;
 	DARRAY(struct audio_channel_info) audio_channels;
+	struct channel_map channel_map;
+	struct resampler_pool resamplers;
+
+	/* audio_channels is only changed by the capture thread, under
+	 * channel_mutex so the settings can walk it; the mixer only ever reads
+	 * channel_list.  retired and channel_pool belong to the capture
+	 * thread */
+	struct channel_list *volatile channel_list;
+	volatile long mix_epoch;
+	DARRAY(struct retired_item) retired;
+	DARRAY(struct audio_channel *) channel_pool;
+	uint64_t last_evict_check;
+	volatile long channel_timeout;
+
+	/* mix as soon as every channel has a block instead of on the timer;
+	 * the capture thread sets mix_ready_event after each batch of packets */
+	volatile bool low_latency;
+	HANDLE mix_ready_event;
+
+	/* with a single live channel the capture thread outputs it directly
+	 * and the mixer idles; direct_channel is owned by the capture thread */
+	struct audio_channel *direct_channel;
+	volatile bool direct_output;
 	size_t block_size;
 	size_t channels;
 	size_t planes;
-	float buffer[MAX_AUDIO_CHANNELS][AUDIO_OUTPUT_FRAMES];
+	float *buffer[MAX_AUDIO_CHANNELS];
+	struct channel_arena mix_arena;
 
-	DARRAY(struct audio_channel *) mix_channels;
+	DARRAY(struct mix_input) mix_inputs;
+	DARRAY(size_t) mix_breaks;
+	DARRAY(const float *) mix_srcs;
 
 	pthread_mutex_t channel_mutex;
 	uint64_t buffered_ts;
 	struct circlebuf buffered_timestamps;
 	uint64_t buffering_wait_ticks;
 	int total_buffering_ticks;
+
+	/* buffering drain state, the mix window runs drain_frames ahead of the
+	 * timestamps in buffered_timestamps until a whole tick is removed */
+	uint64_t min_headroom;
+	int headroom_ticks;
+	uint32_t drain_frames;
+	bool draining;
+
+	struct wasapi_capture_stats stats;
 };
 
 static inline HANDLE open_mutex_plus_id(struct wasapi_capture *wc, const wchar_t *name, DWORD id)
@@ -4,8 +4,10 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdio.h>
+#include <stddef.h>
 
 #include "hook-helpers.h"
+#include "audio-ring.h"
 
 #define EVENT_CAPTURE_RESTART L"CaptureHook_Restart"
 #define EVENT_CAPTURE_STOP L"CaptureHook_Stop"
@@ -17,18 +19,118 @@
 
 #define WINDOW_HOOK_KEEPALIVE L"CaptureHook_KeepAlive"
 
-#define AUDIO_DATA_MUTEX L"CaptureHook_Audio_Data_Mutex"
 #define AUDIO_DATA_EVENT L"CaptureHook_Audio_Data_Event"
 
 #define SHMEM_HOOK_INFO L"CaptureHook_HookInfo"
 #define SHMEM_AUDIO L"CaptureHook_Audio"
 
+#define AUDIO_PACKET_MAGIC 0x4B504157 /* "WAPK" */
+#define AUDIO_PACKET_VERSION 3
+
+/* version 2 moved the stream format out of the packets and into the stream
+ * table, older packets can not be decoded any more */
+#define AUDIO_PACKET_MIN_VERSION 2
+
+#define AUDIO_MAX_STREAMS 64
+
+/* the hook re-anchored the stream's timeline at this packet, its timestamp
+ * does not follow on from the previous one */
+#define AUDIO_PACKET_DISCONTINUITY (1 << 0)
+
+/* the stream is alive but only rendering silence: no samples follow, the
+ * packet just keeps the stream from looking idle.  sent at most every
+ * AUDIO_SILENT_HEARTBEAT_NS per stream */
+#define AUDIO_PACKET_SILENT (1 << 1)
+#define AUDIO_SILENT_HEARTBEAT_NS 250000000ULL
+
+#pragma pack(push, 1)
+
+/* every packet in the audio ring starts with this header, followed by the
+ * interleaved samples at header_size bytes.  fields are only ever appended
+ * (bumping version), so readers must skip header_size rather than
+ * sizeof(struct audio_packet_header) and check audio_packet_has_field before
+ * touching anything newer than they need.  the layout is kept naturally
+ * aligned so it can be read in place from the ring. */
+struct audio_packet_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t header_size;
+	uint32_t data_size;
+	uint32_t frames;
+	uint64_t timestamp;
+
+	/* index into shmem_data::streams and the generation of that entry the
+	 * samples were written with */
+	uint32_t generation;
+	uint16_t stream_index;
+	uint16_t flags;
+
+	/* version 3: position of the first frame in the stream's cumulative
+	 * frame count, silent buffers included */
+	uint64_t frame_index;
+};
+
+#pragma pack(pop)
+
+#define audio_packet_has_field(header, field) \
+	((header)->header_size >= offsetof(struct audio_packet_header, field) + sizeof((header)->field))
+
+static inline bool audio_packet_valid(const struct audio_packet_header *header, uint32_t record_size)
+{
+	return record_size >= offsetof(struct audio_packet_header, flags) + sizeof(header->flags) &&
+	       header->magic == AUDIO_PACKET_MAGIC && header->version >= AUDIO_PACKET_MIN_VERSION &&
+	       audio_packet_has_field(header, flags) && header->header_size <= record_size &&
+	       header->data_size <= record_size - header->header_size && header->stream_index < AUDIO_MAX_STREAMS;
+}
+
+static inline const uint8_t *audio_packet_data(const struct audio_packet_header *header)
+{
+	return (const uint8_t *)header + header->header_size;
+}
+
 #pragma pack(push, 8)
 
+/* format of one IAudioClient stream, registered once by the hook instead of
+ * being repeated in every packet.  generation is a sequence counter: odd
+ * while the hook rewrites the entry, and bumped to a new even value each
+ * time the slot is (re)assigned or the stream format changes.  0 means the
+ * slot was never used. */
+struct audio_stream_desc {
+	volatile uint32_t generation;
+	uint32_t channels;
+	uint32_t samplerate;
+	uint32_t format;
+	uint32_t byte_per_sample;
+	uint32_t reserved;
+	uint64_t client;
+};
+
+/* time the hook spent in IAudioRenderClient::ReleaseBuffer on the target's
+ * render threads, and packets it had to drop; totals since the mapping was
+ * created, updated by the hook's publisher thread */
+struct audio_hook_stats {
+	uint64_t calls;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t dropped;
+
+	/* odd while the hook is updating the counters */
+	volatile uint32_t seq;
+	uint32_t reserved;
+};
+
 struct shmem_data {
-	volatile uint32_t available_audio_size;
 	uint32_t audio_offset;
 	uint32_t buffer_size;
+	uint8_t header_pad[AUDIO_RING_CACHE_LINE - sizeof(uint32_t) * 2];
+
+	/* cursors of the audio packet ring at audio_offset, written by the
+	 * hook (head) and the plugin (tail) without any locking */
+	struct audio_ring_cursors ring;
+
+	struct audio_stream_desc streams[AUDIO_MAX_STREAMS];
+
+	struct audio_hook_stats hook_stats;
 };
 
 struct wasapi_offset {
@@ -48,6 +150,24 @@ struct hook_info {
 
 #pragma pack(pop)
 
+/* copies a stream entry out of shared memory, returns false if it is being
+ * rewritten or no longer has the wanted generation */
+static inline bool audio_stream_desc_read(const struct audio_stream_desc *shared, uint32_t generation, struct audio_stream_desc *desc)
+{
+	if (audio_ring_load_acquire(&shared->generation) != generation)
+		return false;
+
+	desc->channels = shared->channels;
+	desc->samplerate = shared->samplerate;
+	desc->format = shared->format;
+	desc->byte_per_sample = shared->byte_per_sample;
+	desc->client = shared->client;
+
+	audio_ring_fence_acquire();
+	desc->generation = audio_ring_load_acquire(&shared->generation);
+	return desc->generation == generation;
+}
+
 #define GC_MAPPING_FLAGS (FILE_MAP_READ | FILE_MAP_WRITE)
 
 static inline HANDLE create_hook_info(DWORD id)
@@ -16,11 +16,10 @@ HANDLE signal_stop = NULL;
 HANDLE signal_ready = NULL;
 HANDLE signal_exit = NULL;
 static HANDLE signal_init = NULL;
-HANDLE audio_data_mutex = NULL;
 HANDLE audio_data_event = NULL;
 static HANDLE filemap_hook_info = NULL;
 
-static volatile bool stop_loop = false;
+static HANDLE stop_loop = NULL;
 static HANDLE capture_thread = NULL;
 char system_path[MAX_PATH] = {0};
 char process_name[MAX_PATH] = {0};
@@ -30,7 +29,7 @@ static unsigned int shmem_id_counter = 0;
 static void *shmem_info = NULL;
 static HANDLE shmem_file_handle = 0;
 
-volatile bool active = false;
+volatile long capture_state = CAPTURE_STATE_IDLE;
 struct hook_info *global_hook_info = NULL;
 
 static inline void wait_for_dll_main_finish(HANDLE thread_handle)
@@ -49,14 +48,6 @@ static HANDLE init_event(const wchar_t *name, DWORD pid)
 	return handle;
 }
 
-static HANDLE init_mutex(const wchar_t *name, DWORD pid)
-{
-	HANDLE handle = create_mutex_plus_id(name, pid);
-	if (!handle)
-		hlog("Failed to open mutex '%s': %lu", name, GetLastError());
-	return handle;
-}
-
 static inline bool init_signals(void)
 {
 	DWORD pid = GetCurrentProcessId();
@@ -89,15 +80,10 @@ static inline bool init_signals(void)
 	return true;
 }
 
-static inline bool init_mutexes(void)
+static inline bool init_audio_data_event(void)
 {
 	DWORD pid = GetCurrentProcessId();
 
-	audio_data_mutex = init_mutex(AUDIO_DATA_MUTEX, pid);
-	if (!audio_data_mutex) {
-		return false;
-	}
-
 	audio_data_event = init_event(AUDIO_DATA_EVENT, pid);
 	if (!audio_data_event) {
 		return false;
@@ -176,8 +162,8 @@ static void free_hook(void)
 		global_hook_info = NULL;
 	}
 
-	close_handle(&audio_data_mutex);
 	close_handle(&audio_data_event);
+	close_handle(&stop_loop);
 	close_handle(&signal_exit);
 	close_handle(&signal_ready);
 	close_handle(&signal_stop);
@@ -198,19 +184,72 @@ static inline bool attempt_hook(void)
 	return false;
 }
 
+/* the keepalive mutex is not owned by anyone, so losing it can not be waited
+ * on and is the only thing the control loop still polls, and only while
+ * capturing */
+#define KEEPALIVE_INTERVAL_MS 5000
+
+/* capture_stop signals a restart, so after a failed start the next attempt
+ * waits this long, doubling up to the keepalive interval, instead of
+ * spinning on fresh mappings */
+#define RESTART_BACKOFF_MIN_MS 100
+
+static DWORD restart_backoff = RESTART_BACKOFF_MIN_MS;
+
+static inline void capture_retry_later(void)
+{
+	capture_stop();
+
+	WaitForSingleObject(stop_loop, restart_backoff);
+	restart_backoff = min(restart_backoff * 2, KEEPALIVE_INTERVAL_MS);
+}
+
+static inline void capture_update(DWORD wait_result)
+{
+	if (wait_result == WAIT_OBJECT_0 + 1) {
+		if (capture_active())
+			capture_stop();
+
+	} else if (wait_result == WAIT_OBJECT_0 + 2) {
+		if (capture_active() || !capture_alive())
+			return;
+
+		if (capture_start())
+			restart_backoff = RESTART_BACKOFF_MIN_MS;
+		else
+			capture_retry_later();
+
+	} else if (wait_result == WAIT_TIMEOUT) {
+		if (capture_active() && !capture_alive())
+			capture_stop();
+	}
+}
+
+/* the signal and keepalive checks are all kernel calls, so they are done
+ * here rather than on the target's render threads.  the thread sleeps until
+ * one of the signals fires, wait_result's index matches events[] */
 static inline void capture_loop(void)
 {
-	WaitForSingleObject(signal_init, INFINITE);
+	HANDLE init_events[] = {stop_loop, signal_init};
+	HANDLE events[] = {stop_loop, signal_stop, signal_restart};
+
+	if (WaitForMultipleObjects(2, init_events, false, INFINITE) != WAIT_OBJECT_0 + 1)
+		return;
 
-	while (!attempt_hook())
-		Sleep(40);
+	/* wasapi may not be loaded yet, that only resolves by itself */
+	while (!attempt_hook()) {
+		if (WaitForSingleObject(stop_loop, 40) == WAIT_OBJECT_0)
+			return;
+	}
+
+	for (;;) {
+		DWORD timeout = capture_active() ? KEEPALIVE_INTERVAL_MS : INFINITE;
+		DWORD ret = WaitForMultipleObjects(3, events, false, timeout);
 
-	for (size_t n = 0; !stop_loop; n++) {
-		/* this causes it to check every 4 seconds, but still with
-		 * a small sleep interval in case the thread needs to stop */
-		if (n % 100 == 0)
-			attempt_hook();
-		Sleep(40);
+		if (ret == WAIT_OBJECT_0 || ret == WAIT_FAILED)
+			break;
+
+		capture_update(ret);
 	}
 }
 
@@ -312,11 +351,10 @@ static inline bool init_shared_info(size_t size)
 
 bool capture_init_shmem(struct shmem_data **data, uint8_t **data_pointer)
 {
+	/* must stay a power of two, the ring masks its cursors with it */
 	uint32_t audio_size = 1024 * 1024;
-	uint32_t aligned_header = ALIGN(sizeof(struct shmem_data), 32);
-	uint32_t aligned_audio = ALIGN(audio_size, 32);
-	uint32_t total_size = aligned_header + aligned_audio;
-	uintptr_t align_pos;
+	uint32_t aligned_header = ALIGN(sizeof(struct shmem_data), AUDIO_RING_CACHE_LINE);
+	uint32_t total_size = aligned_header + audio_size;
 
 	if (!init_shared_info(total_size)) {
 		hlog("capture_init_shmem: Failed to initialize memory");
@@ -325,19 +363,12 @@ bool capture_init_shmem(struct shmem_data **data, uint8_t **data_pointer)
 
 	*data = shmem_info;
 
-	/* to ensure fast copy rate, align texture data to 256bit addresses */
-	align_pos = (uintptr_t)shmem_info;
-	align_pos += aligned_header;
-	align_pos &= ~(32 - 1);
-	align_pos -= (uintptr_t)shmem_info;
-
-	if (align_pos < sizeof(struct shmem_data))
-		align_pos += 32;
-
-	(*data)->available_audio_size = 0;
-	(*data)->audio_offset = align_pos;
-	(*data)->buffer_size = aligned_audio;
-	*data_pointer = (uint8_t *)shmem_info + align_pos;
+	/* the mapping is page aligned, so this keeps the audio data on its
+	 * own cache lines */
+	(*data)->audio_offset = aligned_header;
+	(*data)->buffer_size = audio_size;
+	audio_ring_reset(&(*data)->ring);
+	*data_pointer = (uint8_t *)shmem_info + aligned_header;
 
 	global_hook_info->map_id = shmem_id_counter;
 	global_hook_info->map_size = total_size;
@@ -347,12 +378,18 @@ bool capture_init_shmem(struct shmem_data **data, uint8_t **data_pointer)
 		return false;
 	}
 
-	active = true;
 	return true;
 }
 
+void capture_set_active(void)
+{
+	InterlockedExchange(&capture_state, CAPTURE_STATE_ACTIVE);
+}
+
 void capture_free(void)
 {
+	InterlockedExchange(&capture_state, CAPTURE_STATE_IDLE);
+
 	if (shmem_info) {
 		UnmapViewOfFile(shmem_info);
 		shmem_info = NULL;
@@ -361,7 +398,6 @@ void capture_free(void)
 	close_handle(&shmem_file_handle);
 
 	SetEvent(signal_restart);
-	active = false;
 }
 
 BOOL WINAPI DllMain(HINSTANCE hinst, DWORD reason, LPVOID unused1)
@@ -384,7 +420,12 @@ BOOL WINAPI DllMain(HINSTANCE hinst, DWORD reason, LPVOID unused1)
 		if (!init_hook_info()) {
 			return false;
 		}
-		if (!init_mutexes()) {
+		if (!init_audio_data_event()) {
+			return false;
+		}
+
+		stop_loop = CreateEvent(NULL, true, false, NULL);
+		if (!stop_loop) {
 			return false;
 		}
 
@@ -401,7 +442,7 @@ BOOL WINAPI DllMain(HINSTANCE hinst, DWORD reason, LPVOID unused1)
 
 	} else if (reason == DLL_PROCESS_DETACH) {
 		if (capture_thread) {
-			stop_loop = true;
+			SetEvent(stop_loop);
 			WaitForSingleObject(capture_thread, 300);
 			CloseHandle(capture_thread);
 		}
@@ -27,8 +27,6 @@ extern uint64_t os_gettime_ns(void);
 
 static inline bool capture_active(void);
 static inline bool capture_ready(void);
-static inline bool capture_should_stop(void);
-static inline bool capture_should_init(void);
 
 extern void shmem_copy_data(size_t idx, void *volatile data);
 extern bool shmem_texture_data_lock(int idx);
@@ -41,6 +39,11 @@ extern bool rehook_gl(void);
 
 extern bool capture_init_shmem(struct shmem_data **data, uint8_t **data_pointer);
 extern void capture_free(void);
+extern void capture_set_active(void);
+
+/* implemented by the wasapi capturer, only called from the control thread */
+extern bool capture_start(void);
+extern void capture_stop(void);
 
 extern struct hook_info *global_hook_info;
 
@@ -61,13 +64,21 @@ extern HANDLE signal_restart;
 extern HANDLE signal_stop;
 extern HANDLE signal_ready;
 extern HANDLE signal_exit;
-extern HANDLE audio_data_mutex;
 extern HANDLE audio_data_event;
 extern char system_path[MAX_PATH];
 extern char process_name[MAX_PATH];
 extern wchar_t keepalive_name[64];
 extern HWND dummy_window;
-extern volatile bool active;
+
+/* the only capture state the target's render threads ever look at.  the
+ * control thread owns the signals and the shared memory and flips this
+ * once everything is set up or before anything is torn down */
+enum capture_state {
+	CAPTURE_STATE_IDLE,
+	CAPTURE_STATE_ACTIVE,
+};
+
+extern volatile long capture_state;
 
 static inline const char *get_process_name(void)
 {
@@ -121,48 +132,11 @@ static inline bool capture_alive(void)
 
 static inline bool capture_active(void)
 {
-	return active;
-}
-
-static inline bool capture_stopped(void)
-{
-	return WaitForSingleObject(signal_stop, 0) == WAIT_OBJECT_0;
-}
-
-static inline bool capture_restarted(void)
-{
-	return WaitForSingleObject(signal_restart, 0) == WAIT_OBJECT_0;
-}
-
-static inline bool capture_should_stop(void)
-{
-	bool stop_requested = false;
-
-	if (capture_active()) {
-		static uint64_t last_keepalive_check = 0;
-		uint64_t cur_time = os_gettime_ns();
-		bool alive = true;
-
-		if (cur_time - last_keepalive_check > 5000000000) {
-			alive = capture_alive();
-			last_keepalive_check = cur_time;
-		}
-
-		stop_requested = capture_stopped() || !alive;
-	}
-
-	return stop_requested;
-}
-
-static inline bool capture_should_init(void)
-{
-	if (!capture_active() && capture_restarted()) {
-		if (capture_alive()) {
-			return true;
-		}
-	}
-
-	return false;
+	/* x86 loads already have acquire semantics, the barrier only keeps
+	 * the compiler from hoisting the reads of the capture data above it */
+	long state = capture_state;
+	_ReadWriteBarrier();
+	return state == CAPTURE_STATE_ACTIVE;
 }
 
 #ifdef __cplusplus
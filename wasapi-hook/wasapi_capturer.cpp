@@ -15,6 +15,12 @@
 		}                     \
 	}
 
+/* how far the frame counter based timeline may fall behind or run ahead of
+ * the clock before the stream is re-anchored; running ahead is normal while
+ * a client pre-fills its device buffer */
+#define STREAM_RESYNC_BEHIND 40000000ULL
+#define STREAM_RESYNC_AHEAD 1000000000ULL
+
 static WASCaptureData capture_data;
 
 #ifdef __cplusplus
@@ -37,10 +43,9 @@ HRESULT STDMETHODCALLTYPE hookAudioClientGetService(IAudioClient *audio_client,
 
 HRESULT STDMETHODCALLTYPE hookAudioRenderClientReleaseBuffer(IAudioRenderClient *pAudioRenderClient, UINT32 nFrameWritten, DWORD dwFlags)
 {
-	if (!(dwFlags & AUDCLNT_BUFFERFLAGS_SILENT)) {
-		capture_data.capture_check(pAudioRenderClient);
-		capture_data.out_audio_data(pAudioRenderClient, nFrameWritten);
-	}
+	/* silent buffers still advance the stream's frame counter */
+	if (capture_active())
+		capture_data.out_audio_data(pAudioRenderClient, nFrameWritten, !!(dwFlags & AUDCLNT_BUFFERFLAGS_SILENT), os_gettime_ns());
 	return realAudioRenderClientReleaseBuffer(pAudioRenderClient, nFrameWritten, dwFlags);
 }
 
@@ -84,62 +89,479 @@ static void waveformatToAudioInfo(WAVEFORMATEX *wfex, WASCaptureData::audio_info
 	info->byte_per_sample = wfex->wBitsPerSample / 8;
 }
 
-void WASCaptureData::out_audio_data(IAudioRenderClient *pAudioRenderClient, UINT32 nFrameWritten)
+static inline bool info_matches(const WASCaptureData::audio_info &a, const WASCaptureData::audio_info &b)
 {
-	if (nFrameWritten == 0)
-		return;
+	return a.samplerate == b.samplerate && a.channels == b.channels && a.byte_per_sample == b.byte_per_sample && a.format == b.format;
+}
+
+void WASCaptureData::reset_streams()
+{
+	for (stream_slot &slot : _streams)
+		slot = stream_slot();
+	_stream_indices.clear();
+}
+
+void WASCaptureData::publish_stream(uint16_t index, const staged_packet *packet)
+{
+	struct audio_stream_desc *desc = &_shmem_data_info->streams[index];
+	stream_slot &slot = _streams[index];
+
+	/* odd generation while rewriting, so the plugin never picks up a
+	 * half written entry */
+	audio_ring_store_release(&desc->generation, slot.generation + 1);
+	audio_ring_fence_release();
+
+	desc->channels = packet->info.channels;
+	desc->samplerate = packet->info.samplerate;
+	desc->format = packet->info.format;
+	desc->byte_per_sample = packet->info.byte_per_sample;
+	desc->client = (uint64_t)(uintptr_t)packet->audio_client;
+
+	slot.generation += 2;
+	audio_ring_store_release(&desc->generation, slot.generation);
+
+	/* a new format starts a new timeline */
+	slot.anchor_ts = 0;
+
+	slot.audio_client = packet->audio_client;
+	slot.info = packet->info;
+}
+
+uint16_t WASCaptureData::stream_index(const staged_packet *packet)
+{
+	IAudioRenderClient *render_client = packet->render_client;
+	uint16_t index = 0;
+
+	auto it = _stream_indices.find(render_client);
+	if (it != _stream_indices.end()) {
+		index = it->second;
+	} else {
+		/* take a free slot, or recycle the one that has been idle the
+		 * longest; its generation keeps counting up so the plugin sees
+		 * the change */
+		for (uint16_t i = 1; i < AUDIO_MAX_STREAMS; i++) {
+			if (_streams[i].last_used < _streams[index].last_used)
+				index = i;
+		}
+
+		if (_streams[index].render_client)
+			_stream_indices.erase(_streams[index].render_client);
+
+		_streams[index].render_client = render_client;
+		_streams[index].audio_client = nullptr;
+		_streams[index].frame_pos = 0;
+		_stream_indices[render_client] = index;
+	}
+
+	stream_slot &slot = _streams[index];
+	slot.last_used = packet->timestamp;
+
+	if (slot.audio_client != packet->audio_client || !info_matches(slot.info, packet->info))
+		publish_stream(index, packet);
+
+	return index;
+}
+
+static inline uint64_t frames_to_ns(uint64_t frames, uint32_t samplerate)
+{
+	return frames / samplerate * 1000000000ULL + frames % samplerate * 1000000000ULL / samplerate;
+}
+
+/* timestamps follow the stream's own frame counter from an anchor taken with
+ * the clock, so the render thread's scheduling jitter does not end up in
+ * them.  the anchor is only moved when counter and clock disagree by more
+ * than the resync thresholds, and that packet is flagged as a
+ * discontinuity */
+uint64_t WASCaptureData::stream_timestamp(stream_slot &slot, uint64_t now, uint16_t *flags)
+{
+	if (slot.anchor_ts && slot.info.samplerate) {
+		uint64_t ts = slot.anchor_ts + frames_to_ns(slot.frame_pos - slot.anchor_frame, (uint32_t)slot.info.samplerate);
+		if (now <= ts + STREAM_RESYNC_BEHIND && ts <= now + STREAM_RESYNC_AHEAD)
+			return ts;
+	}
 
-	uint64_t timestamp = os_gettime_ns();
+	slot.anchor_ts = now;
+	slot.anchor_frame = slot.frame_pos;
+	*flags |= AUDIO_PACKET_DISCONTINUITY;
+	return now;
+}
+
+/* ------------------------------------------------------------------------- */
+/* render threads                                                            */
 
-	std::unique_lock<std::mutex> lk(_mutex);
-	if (!capture_active())
+/* the first packet of a render thread claims a free slot, which happens once
+ * per thread; slots of threads that exited are handed back by the
+ * publisher.  a thread that found them all taken only looks again after
+ * HOOK_STAGING_RETRY_NS, not on every packet */
+WASCaptureData::staging_slot *WASCaptureData::claim_staging_slot(uint64_t now)
+{
+	static thread_local staging_slot *slot = nullptr;
+	static thread_local uint64_t retry_at = 0;
+
+	if (slot)
+		return slot;
+	if (now < retry_at)
+		return nullptr;
+
+	HANDLE thread;
+	if (!DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &thread, SYNCHRONIZE, false, 0))
+		return nullptr;
+
+	LONG tid = (LONG)GetCurrentThreadId();
+	for (staging_slot &candidate : _staging) {
+		if (InterlockedCompareExchange(&candidate.owner, tid, 0) == 0) {
+			candidate.thread = thread;
+			slot = &candidate;
+			return slot;
+		}
+	}
+
+	CloseHandle(thread);
+	retry_at = now + HOOK_STAGING_RETRY_NS;
+	return nullptr;
+}
+
+void WASCaptureData::out_audio_data(IAudioRenderClient *pAudioRenderClient, UINT32 nFrameWritten, bool silent, uint64_t start_ns)
+{
+	if (nFrameWritten == 0 || !_staging_data)
 		return;
 
-	IAudioClient *audio_client = *(IAudioClient **)((uintptr_t)pAudioRenderClient + global_hook_info->offset.audio_client_offset);
+	/* without a slot there are no per slot stats to count the drop in */
+	staging_slot *slot = claim_staging_slot(start_ns);
+	if (!slot) {
+		InterlockedIncrement(&_unstaged_dropped);
+		return;
+	}
+
 	uint8_t *buffer = *(uint8_t **)((uintptr_t)pAudioRenderClient + global_hook_info->offset.buffer_offset);
 	WAVEFORMATEX *wfex = *(WAVEFORMATEX **)((uintptr_t)pAudioRenderClient + global_hook_info->offset.waveformat_offset);
+	uint32_t len = silent ? 0 : nFrameWritten * wfex->nChannels * wfex->wBitsPerSample / 8;
+	uint32_t inline_len = len;
+	uint8_t *external = nullptr;
+
+	if (len > HOOK_STAGING_INLINE_MAX) {
+		external = (uint8_t *)HeapAlloc(GetProcessHeap(), 0, len);
+		inline_len = 0;
+	}
+
+	/* if the publisher falls behind far enough to fill the slot this
+	 * packet is dropped rather than blocking the render thread */
+	staged_packet *packet = nullptr;
+	if (!len || inline_len || external)
+		packet = (staged_packet *)audio_ring_reserve(&slot->writer, sizeof(staged_packet) + inline_len);
+	if (packet) {
+		packet->render_client = pAudioRenderClient;
+		packet->audio_client =
+			*(IAudioClient **)((uintptr_t)pAudioRenderClient + global_hook_info->offset.audio_client_offset);
+		packet->timestamp = start_ns;
+		packet->frames = nFrameWritten;
+		packet->data_size = len;
+		packet->silent = silent;
+		packet->external = external;
+		waveformatToAudioInfo(wfex, &packet->info);
+		memcpy(external ? external : (uint8_t *)(packet + 1), buffer, len);
+		audio_ring_commit(&slot->writer);
+
+		/* only wake the publisher if it is about to sleep, under load it
+		 * picks the packet up with the rest of its batch */
+		if (InterlockedCompareExchange(&_publisher_idle, 0, 1) == 1)
+			SetEvent(_publish_event);
+	} else if (external) {
+		HeapFree(GetProcessHeap(), 0, external);
+	}
+
+	update_slot_stats(slot, os_gettime_ns() - start_ns, !packet);
+}
+
+/* the only writer is the slot's own render thread, so a plain sequence
+ * counter is enough and the hot path never does a locked operation */
+void WASCaptureData::update_slot_stats(staging_slot *slot, uint64_t cost, bool dropped)
+{
+	uint32_t seq = slot->stats_seq;
+
+	audio_ring_store_release(&slot->stats_seq, seq + 1);
+	audio_ring_fence_release();
+
+	slot->calls++;
+	slot->total_ns += cost;
+	if (cost > slot->max_ns)
+		slot->max_ns = cost;
+	if (dropped)
+		slot->dropped++;
+
+	audio_ring_store_release(&slot->stats_seq, seq + 2);
+}
+
+void WASCaptureData::read_slot_stats(const staging_slot &slot, struct audio_hook_stats *stats)
+{
+	/* a render thread killed halfway through an update leaves the counter
+	 * odd for good, its last copy is still close enough then */
+	for (int attempt = 0; attempt < 64; attempt++) {
+		uint32_t seq = audio_ring_load_acquire(&slot.stats_seq);
+		stats->calls = slot.calls;
+		stats->total_ns = slot.total_ns;
+		stats->max_ns = slot.max_ns;
+		stats->dropped = slot.dropped;
+		audio_ring_fence_acquire();
+
+		if (!(seq & 1) && audio_ring_load_acquire(&slot.stats_seq) == seq)
+			break;
+		YieldProcessor();
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* publisher thread                                                          */
+
+/* the slot holds a handle to its thread, so the id stays taken until the
+ * slot lets go of it here, and a thread that is gone can not write to its
+ * slot any more */
+void WASCaptureData::release_dead_slots()
+{
+	for (staging_slot &slot : _staging) {
+		HANDLE thread = slot.thread;
+		if (!slot.owner || !thread || audio_ring_used(&slot.reader))
+			continue;
+
+		if (WaitForSingleObject(thread, 0) != WAIT_OBJECT_0)
+			continue;
 
-	audio_info info;
-	waveformatToAudioInfo(wfex, &info);
-
-	uint32_t len = nFrameWritten * wfex->nChannels * wfex->wBitsPerSample / 8;
-
-	DWORD wait_result = WAIT_FAILED;
-	wait_result = WaitForSingleObject(audio_data_mutex, 0);
-	if (wait_result == WAIT_OBJECT_0 || wait_result == WAIT_ABANDONED) {
-		uint32_t count = len + 36;
-		if (_shmem_data_info->available_audio_size + count <= _shmem_data_info->buffer_size) {
-			memcpy(audio_data_pointer + _shmem_data_info->available_audio_size, &count, 4);
-			memcpy(audio_data_pointer + _shmem_data_info->available_audio_size + 4, &audio_client, 8);
-			memcpy(audio_data_pointer + _shmem_data_info->available_audio_size + 12, &info.channels, 4);
-			memcpy(audio_data_pointer + _shmem_data_info->available_audio_size + 16, &info.samplerate, 4);
-			memcpy(audio_data_pointer + _shmem_data_info->available_audio_size + 20, &info.format, 4);
-			memcpy(audio_data_pointer + _shmem_data_info->available_audio_size + 24, &info.byte_per_sample, 4);
-			memcpy(audio_data_pointer + _shmem_data_info->available_audio_size + 28, &timestamp, 8);
-			memcpy(audio_data_pointer + _shmem_data_info->available_audio_size + 36, buffer, len);
-			_shmem_data_info->available_audio_size += count;
+		slot.thread = NULL;
+		CloseHandle(thread);
+		InterlockedExchange(&slot.owner, 0);
+	}
+}
+
+void WASCaptureData::discard_staged(staging_slot &slot)
+{
+	const staged_packet *packet;
+	uint32_t size;
+
+	while ((packet = (const staged_packet *)audio_ring_peek(&slot.reader, &size)) != nullptr) {
+		if (size >= sizeof(*packet) && packet->external)
+			HeapFree(GetProcessHeap(), 0, packet->external);
+		audio_ring_release(&slot.reader);
+	}
+}
+
+bool WASCaptureData::publish_packet(const staged_packet *packet)
+{
+	uint16_t index = stream_index(packet);
+	stream_slot &slot = _streams[index];
+	uint16_t flags = 0;
+	uint64_t timestamp = stream_timestamp(slot, packet->timestamp, &flags);
+	uint64_t frame_index = slot.frame_pos;
+
+	slot.frame_pos += packet->frames;
+	if (packet->silent) {
+		/* a silent stream only sends the odd empty packet so the plugin
+		 * does not evict it */
+		if (packet->timestamp - slot.last_published < AUDIO_SILENT_HEARTBEAT_NS)
+			return false;
+		flags |= AUDIO_PACKET_SILENT;
+	}
+
+	/* the plugin drains the ring on its own thread, if it falls behind far
+	 * enough to fill it this packet is dropped */
+	auto header = (struct audio_packet_header *)audio_ring_reserve(&_ring, sizeof(struct audio_packet_header) + packet->data_size);
+	if (!header) {
+		_ring_dropped++;
+		return false;
+	}
+
+	header->magic = AUDIO_PACKET_MAGIC;
+	header->version = AUDIO_PACKET_VERSION;
+	header->header_size = sizeof(struct audio_packet_header);
+	header->data_size = packet->data_size;
+	header->frames = packet->frames;
+	header->timestamp = timestamp;
+	header->generation = slot.generation;
+	header->stream_index = index;
+	header->flags = flags;
+	header->frame_index = frame_index;
+	memcpy(header + 1, packet->external ? packet->external : (const uint8_t *)(packet + 1), packet->data_size);
+	audio_ring_commit(&_ring);
+
+	slot.last_published = packet->timestamp;
+	return true;
+}
+
+/* moves everything staged so far into shared memory, returns true if any
+ * packet was published */
+bool WASCaptureData::publish_staged()
+{
+	bool published = false;
+	uint32_t size;
+
+	for (staging_slot &slot : _staging) {
+		const staged_packet *packet;
+
+		while ((packet = (const staged_packet *)audio_ring_peek(&slot.reader, &size)) != nullptr) {
+			if (size >= sizeof(*packet) + (packet->external ? 0 : packet->data_size))
+				published |= publish_packet(packet);
+			if (size >= sizeof(*packet) && packet->external)
+				HeapFree(GetProcessHeap(), 0, packet->external);
+			audio_ring_release(&slot.reader);
 		}
-		ReleaseMutex(audio_data_mutex);
-		SetEvent(audio_data_event);
 	}
+
+	return published;
+}
+
+void WASCaptureData::publish_stats()
+{
+	struct audio_hook_stats stats = {};
+	struct audio_hook_stats *shared = &_shmem_data_info->hook_stats;
+	stats.dropped = _ring_dropped + (ULONG)_unstaged_dropped;
+
+	for (staging_slot &slot : _staging) {
+		struct audio_hook_stats slot_stats;
+
+		read_slot_stats(slot, &slot_stats);
+		stats.calls += slot_stats.calls;
+		stats.total_ns += slot_stats.total_ns;
+		stats.dropped += slot_stats.dropped;
+		if (slot_stats.max_ns > stats.max_ns)
+			stats.max_ns = slot_stats.max_ns;
+	}
+
+	/* the plugin reads these under seq as well, it is 64 bit but this side
+	 * may not be */
+	uint32_t seq = shared->seq;
+	audio_ring_store_release(&shared->seq, seq + 1);
+	audio_ring_fence_release();
+	shared->calls = stats.calls;
+	shared->total_ns = stats.total_ns;
+	shared->max_ns = stats.max_ns;
+	shared->dropped = stats.dropped;
+	audio_ring_store_release(&shared->seq, seq + 2);
 }
 
-void WASCaptureData::capture_check(IAudioRenderClient *pAudioRenderClient)
+void WASCaptureData::publisher_loop()
 {
-	std::unique_lock<std::mutex> lk(_mutex);
+	uint64_t last_release = 0;
+
+	while (!_publisher_stop) {
+		/* one event per batch, however many packets it held */
+		if (publish_staged())
+			SetEvent(audio_data_event);
+
+		uint64_t now = os_gettime_ns();
+		if (now - last_release >= 1000000000ULL) {
+			publish_stats();
+			release_dead_slots();
+			last_release = now;
+		}
 
-	if (capture_should_stop()) {
-		capture_free();
+		/* the render threads check the flag after committing, so any
+		 * packet staged after the last pass either shows up in this
+		 * check or sets the event */
+		InterlockedExchange(&_publisher_idle, 1);
+		bool pending = false;
+		for (staging_slot &slot : _staging)
+			pending |= audio_ring_used(&slot.reader) != 0;
+		if (!pending)
+			WaitForSingleObject(_publish_event, 100);
+		InterlockedExchange(&_publisher_idle, 0);
 	}
 
-	WAVEFORMATEX *wfex = *(WAVEFORMATEX **)((uintptr_t)pAudioRenderClient + global_hook_info->offset.waveformat_offset);
-	if (capture_should_init()) {
-		audio_info info;
-		waveformatToAudioInfo(wfex, &info);
-		bool success = capture_init_shmem(&_shmem_data_info, &audio_data_pointer);
-		if (!success)
-			capture_free();
+	publish_stats();
+}
+
+DWORD WINAPI WASCaptureData::publisher_thread(LPVOID param)
+{
+	static_cast<WASCaptureData *>(param)->publisher_loop();
+	return 0;
+}
+
+bool WASCaptureData::start_publisher()
+{
+	if (!_staging_data) {
+		auto data = (uint8_t *)VirtualAlloc(NULL, HOOK_STAGING_SLOTS * HOOK_STAGING_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if (!data) {
+			hlog("start_publisher: failed to allocate staging memory: %lu", GetLastError());
+			return false;
+		}
+
+		for (size_t i = 0; i < HOOK_STAGING_SLOTS; i++) {
+			staging_slot &slot = _staging[i];
+
+			audio_ring_attach(&slot.writer, &slot.cursors, data + i * HOOK_STAGING_SIZE, HOOK_STAGING_SIZE);
+			audio_ring_attach(&slot.reader, &slot.cursors, data + i * HOOK_STAGING_SIZE, HOOK_STAGING_SIZE);
+		}
+
+		/* render threads only look at the slots once this is set */
+		MemoryBarrier();
+		_staging_data = data;
 	}
+
+	/* the slots outlive a capture session because a render thread may still
+	 * be writing to its slot while the old session is torn down, so only
+	 * the consumer side is reset here */
+	for (staging_slot &slot : _staging)
+		discard_staged(slot);
+	_ring_dropped = 0;
+	InterlockedExchange(&_unstaged_dropped, 0);
+
+	if (!_publish_event)
+		_publish_event = CreateEvent(NULL, false, false, NULL);
+
+	_publisher_stop = false;
+	_publisher = CreateThread(NULL, 0, publisher_thread, this, 0, NULL);
+	if (!_publisher) {
+		hlog("start_publisher: failed to create thread: %lu", GetLastError());
+		return false;
+	}
+
+	return true;
+}
+
+void WASCaptureData::stop_publisher()
+{
+	if (!_publisher)
+		return;
+
+	_publisher_stop = true;
+	SetEvent(_publish_event);
+	WaitForSingleObject(_publisher, INFINITE);
+	CloseHandle(_publisher);
+	_publisher = NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+bool WASCaptureData::start()
+{
+	if (!capture_init_shmem(&_shmem_data_info, &audio_data_pointer))
+		return false;
+
+	audio_ring_attach(&_ring, &_shmem_data_info->ring, audio_data_pointer, _shmem_data_info->buffer_size);
+	reset_streams();
+	if (!start_publisher())
+		return false;
+
+	/* render threads start staging packets from here on */
+	capture_set_active();
+	return true;
+}
+
+void WASCaptureData::stop()
+{
+	/* render threads stop on the next buffer, one that is already past
+	 * the check only writes to its own staging slot */
+	InterlockedExchange(&capture_state, CAPTURE_STATE_IDLE);
+	stop_publisher();
+	capture_free();
+}
+
+bool capture_start(void)
+{
+	return capture_data.start();
+}
+
+void capture_stop(void)
+{
+	capture_data.stop();
 }
 
 bool hook_wasapi()
@@ -13,6 +13,7 @@
 #include <assert.h>
 #include <mutex>
 #include <map>
+#include <unordered_map>
 #include <ctime>   // std::time
 #include <iomanip> // std::put_time
 #include <immintrin.h>
@@ -24,6 +25,23 @@
 #include <wincodec.h>
 
 #include "circlebuf.h"
+#include "../audio-ring.h"
+#include "../wasapi-hook-info.h"
+
+/* a render thread's packets waiting for the publisher thread.  each slot is
+ * claimed by one render thread, so it is a plain single producer/single
+ * consumer ring and the render thread never waits on anything */
+#define HOOK_STAGING_SLOTS 16
+#define HOOK_STAGING_SIZE (128 * 1024)
+
+/* how long a render thread that found no free slot waits before it tries
+ * again, its packets are counted as dropped meanwhile */
+#define HOOK_STAGING_RETRY_NS 1000000000ULL
+
+/* larger buffers are copied to the heap and only a reference to the copy
+ * goes through the slot, so they neither get dropped nor crowd out the
+ * packets behind them */
+#define HOOK_STAGING_INLINE_MAX (HOOK_STAGING_SIZE / 4)
 
 class WASCaptureData {
 public:
@@ -41,13 +59,100 @@ public:
 	WASCaptureData();
 	~WASCaptureData();
 
-	void capture_check(IAudioRenderClient *pAudioRenderClient);
-	void out_audio_data(IAudioRenderClient *pAudioRenderClient, UINT32 nFrameWritten);
+	/* control thread */
+	bool start();
+	void stop();
+
+	/* render threads */
+	void out_audio_data(IAudioRenderClient *pAudioRenderClient, UINT32 nFrameWritten, bool silent, uint64_t start_ns);
 
 private:
+	/* everything the publisher needs to know about a packet, copied out of
+	 * the render client because the target may release it at any time */
+	struct staged_packet {
+		IAudioRenderClient *render_client;
+		IAudioClient *audio_client;
+		uint64_t timestamp;
+		uint32_t frames;
+		uint32_t data_size;
+		audio_info info;
+		uint32_t silent;
+
+		/* heap copy of the samples for buffers over
+		 * HOOK_STAGING_INLINE_MAX, freed by the publisher; otherwise
+		 * they follow the packet */
+		uint8_t *external;
+	};
+
+	struct staging_slot {
+		/* the owning thread's id and a handle to it, which also keeps
+		 * windows from reusing the id while the slot is claimed */
+		volatile LONG owner = 0;
+		HANDLE volatile thread = NULL;
+		struct audio_ring_cursors cursors = {};
+		struct audio_ring writer = {};
+		struct audio_ring reader = {};
+
+		/* written by the owning render thread only.  64 bit loads tear on
+		 * the 32 bit build, so the publisher reads them under stats_seq,
+		 * odd while the render thread is updating them */
+		volatile uint32_t stats_seq = 0;
+		uint64_t calls = 0;
+		uint64_t total_ns = 0;
+		uint64_t max_ns = 0;
+		uint64_t dropped = 0;
+	};
+
+	/* hook side state of a slot in shmem_data::streams, used to notice
+	 * format changes without re-deriving audio_info on every call.  only
+	 * the publisher thread touches it */
+	struct stream_slot {
+		IAudioRenderClient *render_client = nullptr;
+		IAudioClient *audio_client = nullptr;
+		audio_info info;
+		uint32_t generation = 0;
+		uint64_t last_used = 0;
+		uint64_t last_published = 0;
+
+		uint64_t frame_pos = 0;
+		uint64_t anchor_ts = 0;
+		uint64_t anchor_frame = 0;
+	};
+
+	staging_slot *claim_staging_slot(uint64_t now);
+	void update_slot_stats(staging_slot *slot, uint64_t cost, bool dropped);
+	static void read_slot_stats(const staging_slot &slot, struct audio_hook_stats *stats);
+	void release_dead_slots();
+	bool start_publisher();
+	void stop_publisher();
+	static DWORD WINAPI publisher_thread(LPVOID param);
+	void publisher_loop();
+	bool publish_staged();
+	bool publish_packet(const staged_packet *packet);
+	static void discard_staged(staging_slot &slot);
+	void publish_stats();
+
+	uint64_t stream_timestamp(stream_slot &slot, uint64_t now, uint16_t *flags);
+	uint16_t stream_index(const staged_packet *packet);
+	void publish_stream(uint16_t index, const staged_packet *packet);
+	void reset_streams();
+
+	stream_slot _streams[AUDIO_MAX_STREAMS];
+	std::unordered_map<IAudioRenderClient *, uint16_t> _stream_indices;
+
+	staging_slot _staging[HOOK_STAGING_SLOTS];
+	uint8_t *_staging_data = nullptr;
+
+	HANDLE _publisher = NULL;
+	HANDLE _publish_event = NULL;
+	volatile LONG _publisher_idle = 0;
+	volatile bool _publisher_stop = false;
+	uint64_t _ring_dropped = 0;
+	volatile LONG _unstaged_dropped = 0;
+
 	uint8_t *audio_data_pointer = nullptr;
 	struct shmem_data *_shmem_data_info;
-	std::mutex _mutex;
+	struct audio_ring _ring = {};
 };
 
 #endif